@@ -41,10 +41,11 @@ int main(int argc, const char *argv[])
     bool bVis = false;            // visualize results
 
     /* MAIN LOOP OVER ALL IMAGES */
-    string detectorType =  "FAST";       // {"FAST" , "BRISK" , "SIFT" , "ORB" , "AKAZE" , "HARRIS" , "SHITOMASI"}
-    string descriptorType =  "BRIEF";   //{"BRIEF" , "SIFT" , "ORB" , "AKAZE" , "BRISK" };
-    string matcherType = "MAT_BF";     //{"MAT_BF" , "MAT_FLANN"}; 
-    string selectorType = "SEL_NN";   //{"SEL_NN" , "SEL_KNN"};    
+    DetectorType detectorType = DetectorType::FAST;        // FAST, BRISK, SIFT, ORB, AKAZE, HARRIS, SHITOMASI
+    DescriptorType descriptorType = DescriptorType::BRIEF; // BRIEF, SIFT, ORB, FREAK, AKAZE, BRISK
+    MatcherType matcherType = MatcherType::MAT_BF;         // MAT_BF, MAT_FLANN
+    SelectorType selectorType = SelectorType::SEL_NN;      // SEL_NN, SEL_KNN
+    FeaturePipeline pipeline(detectorType, descriptorType, matcherType, selectorType);
 
     double total_time =0 , t1 =0 , t2 =0;
     for (size_t imgIndex = 0; imgIndex <= imgEndIndex - imgStartIndex; imgIndex++)
@@ -83,44 +84,29 @@ int main(int argc, const char *argv[])
         // extract 2D keypoints from current image
         vector<cv::KeyPoint> keypoints; // create empty feature list for current image
 
-        //// STUDENT ASSIGNMENT
-        //// TASK MP.2 -> add the following keypoint detectors in file matching2D.cpp and enable string-based selection based on detectorType
-        //// -> HARRIS, FAST, BRISK, ORB, AKAZE, SIFT
-        t1= cv::getTickCount();
-        if (detectorType.compare("SHITOMASI") == 0)
-        {
-            detKeypointsShiTomasi(keypoints, imgGray, false);
-        }
-        else 
-        {
-             detKeypointsModern(keypoints, imgGray, detectorType, false);
-        }
-        t1 =( cv::getTickCount() - t1 )/ cv::getTickFrequency();
-        t1 *= 1000 / 1.0;
-
-        //// EOF STUDENT ASSIGNMENT
-
         //// STUDENT ASSIGNMENT
         //// TASK MP.3 -> only keep keypoints on the preceding vehicle
 
-        // only keep keypoints on the preceding vehicle
+        // only keep keypoints on the preceding vehicle, applied as a detection mask so that descriptors computed
+        // together with the keypoints stay valid
         bool bFocusOnVehicle = true;
-        vector<cv::KeyPoint> keypoints_edited;
         cv::Rect vehicleRect(535, 180, 180, 150);
+        cv::Mat vehicleMask;
         if (bFocusOnVehicle)
         {
-            for(auto it = keypoints.begin() ; it != keypoints.end() ; it++)
-            {
-                if(vehicleRect.contains(it->pt))
-                {
-                    cv::KeyPoint newKeyPoint;
-                    newKeyPoint.pt = cv::Point2f(it->pt);
-                    newKeyPoint.size = 1;
-                    keypoints_edited.push_back(newKeyPoint);
-                }  
-            }
+            vehicleMask = cv::Mat::zeros(imgGray.size(), CV_8U);
+            vehicleMask(vehicleRect).setTo(cv::Scalar(255));
         }
-        keypoints=keypoints_edited;
+
+        //// EOF STUDENT ASSIGNMENT
+
+        //// STUDENT ASSIGNMENT
+        //// TASK MP.2 -> add the following keypoint detectors in file matching2D.cpp and enable selection based on detectorType
+        //// -> HARRIS, FAST, BRISK, ORB, AKAZE, SIFT
+        t1= cv::getTickCount();
+        pipeline.detect(imgGray, keypoints, vehicleMask);
+        t1 =( cv::getTickCount() - t1 )/ cv::getTickFrequency();
+        t1 *= 1000 / 1.0;
 
         //// EOF STUDENT ASSIGNMENT
 
@@ -130,7 +116,7 @@ int main(int argc, const char *argv[])
         {
             int maxKeypoints = 50;
 
-            if (detectorType.compare("SHITOMASI") == 0)
+            if (detectorType == DetectorType::SHITOMASI)
             { // there is no response info, so keep the first 50 as they are sorted in descending quality order
                 keypoints.erase(keypoints.begin() + maxKeypoints, keypoints.end());
             }
@@ -145,12 +131,12 @@ int main(int argc, const char *argv[])
         /* EXTRACT KEYPOINT DESCRIPTORS */
 
         //// STUDENT ASSIGNMENT
-        //// TASK MP.4 -> add the following descriptors in file matching2D.cpp and enable string-based selection based on descriptorType
+        //// TASK MP.4 -> add the following descriptors in file matching2D.cpp and enable selection based on descriptorType
         //// -> BRIEF, ORB, FREAK, AKAZE, SIFT
 
         cv::Mat descriptors;
         t2 =cv::getTickCount();
-        descKeypoints((dataBuffer.end() - 1)->keypoints, (dataBuffer.end() - 1)->cameraImg, descriptors, descriptorType);
+        pipeline.describe((dataBuffer.end() - 1)->cameraImg, (dataBuffer.end() - 1)->keypoints, descriptors);
         t2 =( cv::getTickCount() - t2 )/ cv::getTickFrequency();
         t2 *= 1000 / 1.0;
         //// EOF STUDENT ASSIGNMENT
@@ -160,23 +146,29 @@ int main(int argc, const char *argv[])
 
         cout << "#3 : EXTRACT DESCRIPTORS done" << endl;
 
+        // MP.9 timing, for a fused detector/descriptor pair t1 already holds the description
+        total_time += t1 + t2;
+        if (pipeline.describedDuringDetection())
+        {
+            cout << "MP.9 : detection and description " << t1 << " ms (description folded into detection)" << endl;
+        }
+        else
+        {
+            cout << "MP.9 : detection " << t1 << " ms, description " << t2 << " ms" << endl;
+        }
+
         if (dataBuffer.size() > 1) // wait until at least two images have been processed
         {
 
             /* MATCH KEYPOINT DESCRIPTORS */
 
             vector<cv::DMatch> matches;
-            //string matcherType = "MAT_BF";        // MAT_BF, MAT_FLANN
-            //string descriptorType = "DES_BINARY"; // DES_BINARY, DES_HOG
-            //string selectorType = "SEL_NN";       // SEL_NN, SEL_KNN
 
             //// STUDENT ASSIGNMENT
             //// TASK MP.5 -> add FLANN matching in file matching2D.cpp
             //// TASK MP.6 -> add KNN match selection and perform descriptor distance ratio filtering with t=0.8 in file matching2D.cpp
 
-            matchDescriptors((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints,
-                             (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
-                             matches, descriptorType, matcherType, selectorType);
+            pipeline.match((dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors, matches);
 
             //// EOF STUDENT ASSIGNMENT
 
@@ -206,6 +198,7 @@ int main(int argc, const char *argv[])
         }
 
     } 
+    cout << "MP.9 : detection and description of all images took " << total_time << " ms" << endl;
 
     return 0;
 }
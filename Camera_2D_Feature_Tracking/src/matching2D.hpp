@@ -18,12 +18,83 @@
 
 #include "dataStructures.h"
 
+// Harris corner detection that keeps its buffers between frames.
+// The response is computed in row stripes in parallel and corners are the 3x3 local maxima, found with one
+// dilate and compare, whose response scaled to 0..255 over the image is above minResponse. Overlapping
+// corners are suppressed strongest first with a grid of cells one keypoint diameter wide, so the cost is
+// linear in the number of candidates however low minResponse is. Local maxima where mask is zero are not
+// candidates, so they cannot suppress corners inside the mask; an empty mask keeps all.
+class HarrisDetector
+{
+public:
+    HarrisDetector(int blockSize = 2, int apertureSize = 3, double k = 0.04, int minResponse = 100);
 
-void detKeypointsHarris(cv::Ptr<cv::FeatureDetector> &Detector,std::vector<cv::KeyPoint> &Keys, cv::Mat &img, bool bVis=false);
-void detKeypointsShiTomasi(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis=false);
-void detKeypointsModern(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, bool bVis=false);
-void descKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, std::string descriptorType);
-void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
-                      std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType);
+    void detect(const cv::Mat &img, std::vector<cv::KeyPoint> &keypoints, const cv::Mat &mask=cv::Mat());
+
+private:
+    int blockSize;    // for every pixel, a blockSize × blockSize neighborhood is considered
+    int apertureSize; // aperture parameter for Sobel operator (must be odd)
+    double k;         // Harris parameter
+    int minResponse;  // minimum value for a corner in the 8bit scaled response matrix
+
+    cv::Mat response, dilated;
+    std::vector<cv::Mat> stripeResponses;
+    std::vector<std::vector<cv::KeyPoint>> stripeCandidates;
+    std::vector<cv::KeyPoint> candidates;
+    std::vector<int> cellHeads, nextInCell; // kept keypoints of every grid cell as linked lists
+};
+
+enum class DetectorType { SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE, SIFT };
+enum class DescriptorType { BRISK, BRIEF, ORB, FREAK, AKAZE, SIFT };
+enum class MatcherType { MAT_BF, MAT_FLANN };
+enum class SelectorType { SEL_NN, SEL_KNN };
+
+// Detection, description and matching configured once for a whole image sequence.
+// The OpenCV detector, extractor and matcher are created in the constructor and reused for every frame,
+// and per-frame intermediate results live in member buffers, so a frame neither constructs OpenCV objects
+// nor dispatches on strings.
+// When detector and descriptor are the same algorithm (AKAZE, SIFT, ORB or BRISK) detect already computes
+// the descriptors with one detectAndCompute call, which builds the scale space only once, and describe
+// returns them as long as the keypoints are the ones detect returned.
+class FeaturePipeline
+{
+public:
+    FeaturePipeline(DetectorType detectorType, DescriptorType descriptorType,
+                    MatcherType matcherType = MatcherType::MAT_BF, SelectorType selectorType = SelectorType::SEL_NN);
+
+    // only keypoints where mask is non-zero are kept, an empty mask keeps all
+    void detect(const cv::Mat &img, std::vector<cv::KeyPoint> &keypoints, const cv::Mat &mask=cv::Mat(), bool bVis=false);
+    // describes keypoints of the image last passed to detect,
+    // keypoints for which no descriptor can be computed are removed
+    void describe(const cv::Mat &img, std::vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors);
+    // true if the last describe returned descriptors computed by detect,
+    // the time spent describing is then part of the time spent in detect
+    bool describedDuringDetection() const { return describedInDetect; }
+    void match(const cv::Mat &descSource, const cv::Mat &descRef, std::vector<cv::DMatch> &matches);
+
+private:
+    void detectShiTomasi(const cv::Mat &img, const cv::Mat &mask, std::vector<cv::KeyPoint> &keypoints);
+
+    DetectorType detectorType;
+    DescriptorType descriptorType;
+    MatcherType matcherType;
+    SelectorType selectorType;
+
+    cv::Ptr<cv::FeatureDetector> detector; // empty for SHITOMASI and HARRIS, which are run directly
+    HarrisDetector harris;
+    cv::Ptr<cv::DescriptorExtractor> extractor;
+    cv::Ptr<cv::DescriptorMatcher> matcher;
+    bool fused; // extractor is detector, detect computes the descriptors as well
+
+    // keypoints and descriptors of the last fused detect, until describe takes them
+    std::vector<cv::KeyPoint> fusedKeypoints;
+    cv::Mat fusedDescriptors;
+    bool describedInDetect;
+
+    // per-frame scratch buffers, their memory is kept between frames
+    std::vector<cv::Point2f> corners;
+    cv::Mat descSourceFloat, descRefFloat;
+    std::vector<std::vector<cv::DMatch>> knnMatches;
+};
 
 #endif /* matching2D_hpp */
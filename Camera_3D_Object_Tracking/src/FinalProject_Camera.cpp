@@ -74,6 +74,13 @@ int main(int argc, const char *argv[])
     vector<DataFrame> dataBuffer; // list of data frames which are held in memory at the same time
     bool bVis = false;            // visualize results
 
+    // keypoint detection, description and matching
+    DetectorType detectorType = DetectorType::AKAZE;       // SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE, SIFT
+    DescriptorType descriptorType = DescriptorType::AKAZE; // BRISK, BRIEF, ORB, FREAK, AKAZE, SIFT
+    MatcherType matcherType = MatcherType::MAT_BF;         // MAT_BF, MAT_FLANN
+    SelectorType selectorType = SelectorType::SEL_KNN;     // SEL_NN, SEL_KNN
+    FeaturePipeline pipeline(detectorType, descriptorType, matcherType, selectorType);
+
     /* MAIN LOOP OVER ALL IMAGES */
     for (size_t imgIndex = 0; imgIndex <= imgEndIndex - imgStartIndex; imgIndex+=imgStepWidth)
     {
@@ -149,17 +156,7 @@ int main(int argc, const char *argv[])
 
         // extract 2D keypoints from current image
         vector<cv::KeyPoint> keypoints; // create empty feature list for current image
-        string detectorType = "AKAZE";
-
-        if (detectorType.compare("SHITOMASI") == 0)
-        {
-            detKeypointsShiTomasi(keypoints, imgGray, false);
-        }
-        else
-        {
-            detKeypointsModern(keypoints , imgGray , detectorType, false);
-
-        }
+        pipeline.detect(imgGray, keypoints);
 
         // optional : limit number of keypoints (helpful for debugging and learning)
         bool bLimitKpts = false;
@@ -167,7 +164,7 @@ int main(int argc, const char *argv[])
         {
             int maxKeypoints = 50;
 
-            if (detectorType.compare("SHITOMASI") == 0)
+            if (detectorType == DetectorType::SHITOMASI)
             { // there is no response info, so keep the first 50 as they are sorted in descending quality order
                 keypoints.erase(keypoints.begin() + maxKeypoints, keypoints.end());
             }
@@ -184,8 +181,7 @@ int main(int argc, const char *argv[])
         /* EXTRACT KEYPOINT DESCRIPTORS */
 
         cv::Mat descriptors;
-        string descriptorType = "AKAZE"; // BRISK, BRIEF, ORB, FREAK, AKAZE, SIFT
-        descKeypoints((dataBuffer.end() - 1)->keypoints, (dataBuffer.end() - 1)->cameraImg, descriptors, descriptorType);
+        pipeline.describe((dataBuffer.end() - 1)->cameraImg, (dataBuffer.end() - 1)->keypoints, descriptors);
 
         // push descriptors for current frame to end of data buffer
         (dataBuffer.end() - 1)->descriptors = descriptors;
@@ -199,13 +195,7 @@ int main(int argc, const char *argv[])
             /* MATCH KEYPOINT DESCRIPTORS */
 
             vector<cv::DMatch> matches;
-            string matcherType = "MAT_BF";        // MAT_BF, MAT_FLANN
-            string descriptorType = "DES_BINARY"; // DES_BINARY, DES_HOG
-            string selectorType = "SEL_KNN";       // SEL_NN, SEL_KNN
-
-            matchDescriptors((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints,
-                             (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
-                             matches, descriptorType, matcherType, selectorType);
+            pipeline.match((dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors, matches);
 
             // store matches in current data frame
             (dataBuffer.end() - 1)->kptMatches = matches;
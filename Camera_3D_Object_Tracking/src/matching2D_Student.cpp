@@ -1,263 +1,319 @@
 #include <numeric>
+#include <algorithm>
 #include "matching2D.hpp"
 
 using namespace std;
 
-// Find best matches for keypoints in two camera images based on several matching methods
-void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
-                      std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType)
+HarrisDetector::HarrisDetector(int blockSize, int apertureSize, double k, int minResponse)
+    : blockSize(blockSize), apertureSize(apertureSize), k(k), minResponse(minResponse)
 {
-    // configure matcher
-    bool crossCheck = false;
-    cv::Ptr<cv::DescriptorMatcher> matcher;
+}
 
-    if (matcherType.compare("MAT_BF") == 0)
-    {
-        int normType = cv::NORM_HAMMING;
-        matcher = cv::BFMatcher::create(normType, crossCheck);
-    }
-    else if (matcherType.compare("MAT_FLANN") == 0)
-    {   
-        if (descSource.type() != CV_32F)
-        {   // OpenCV bug workaround : convert binary descriptors to floating point due to a bug in current OpenCV implementation
-            descSource.convertTo(descSource, CV_32F);
-            descRef.convertTo(descRef, CV_32F);
-        }
-        matcher = cv::FlannBasedMatcher::create();
-    }
+void HarrisDetector::detect(const cv::Mat &img, vector<cv::KeyPoint> &keypoints, const cv::Mat &mask)
+{
+    keypoints.clear();
+    int stripes = max(1, min(img.rows / 16, 4 * cv::getNumThreads()));
+    stripeResponses.resize(stripes);
+    stripeCandidates.resize(stripes);
 
-    // perform matching task
-    if (selectorType.compare("SEL_NN") == 0)
-    { // nearest neighbor (best match)
+    // each stripe is filtered with margin rows around it, so its own rows get the same response as on the whole image
+    int margin = blockSize + apertureSize;
+    response.create(img.rows, img.cols, CV_32F);
+    cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range &range) {
+        for (int s = range.start; s < range.end; s++)
+        {
+            int begin = img.rows * s / stripes, end = img.rows * (s + 1) / stripes;
+            int marginBegin = max(0, begin - margin), marginEnd = min(img.rows, end + margin);
+            cv::cornerHarris(img.rowRange(marginBegin, marginEnd), stripeResponses[s], blockSize, apertureSize, k, cv::BORDER_DEFAULT);
+            stripeResponses[s].rowRange(begin - marginBegin, end - marginBegin).copyTo(response.rowRange(begin, end));
+        }
+    });
 
-        matcher->match(descSource, descRef, matches); // Finds the best match for each descriptor in desc1
+    // scaling of the NORM_MINMAX normalization to 0..255, applied to candidates only
+    double minVal, maxVal;
+    cv::minMaxLoc(response, &minVal, &maxVal);
+    if (!(maxVal > minVal))
+    {
+        return;
+    }
+    double scale = 255.0 / (maxVal - minVal);
+    float rawThreshold = minVal + minResponse / scale;
 
+    // a pixel is a local maximum if the 3x3 dilation did not raise it
+    cv::dilate(response, dilated, cv::Mat());
+    cv::parallel_for_(cv::Range(0, stripes), [&](const cv::Range &range) {
+        for (int s = range.start; s < range.end; s++)
+        {
+            vector<cv::KeyPoint> &stripe = stripeCandidates[s];
+            stripe.clear();
+            for (int j = img.rows * s / stripes; j < img.rows * (s + 1) / stripes; j++)
+            {
+                const float *row = response.ptr<float>(j);
+                const float *rowMax = dilated.ptr<float>(j);
+                const uchar *rowMask = mask.empty() ? NULL : mask.ptr<uchar>(j);
+                for (int i = 0; i < img.cols; i++)
+                {
+                    if (row[i] >= rawThreshold && row[i] >= rowMax[i] && (!rowMask || rowMask[i]))
+                    {
+                        int scaled = (row[i] - minVal) * scale;
+                        if (scaled > minResponse)
+                        {
+                            stripe.push_back(cv::KeyPoint(cv::Point2f(i, j), 2 * apertureSize, -1, scaled));
+                        }
+                    }
+                }
+            }
+        }
+    });
+    candidates.clear();
+    for (int s = 0; s < stripes; s++)
+    {
+        candidates.insert(candidates.end(), stripeCandidates[s].begin(), stripeCandidates[s].end());
     }
-    else if (selectorType.compare("SEL_KNN") == 0)
-    { // k nearest neighbors (k=2)
+    stable_sort(candidates.begin(), candidates.end(), [](const cv::KeyPoint &a, const cv::KeyPoint &b) {
+        return a.response > b.response;
+    });
 
-        // ...
-        vector<vector<cv::DMatch>> knn_matches;
-        matcher->knnMatch(descSource,descRef,knn_matches,2);
-        const float ratio_thresh = 0.8f;
-        for (size_t i =0 ; i<knn_matches.size() ; i++)
+    // two keypoints overlap when they are closer than their diameter, which is also the cell size,
+    // so only the 3x3 cells around a candidate can hold a kept keypoint that overlaps it
+    int cellSize = 2 * apertureSize;
+    int gridCols = img.cols / cellSize + 1, gridRows = img.rows / cellSize + 1;
+    cellHeads.assign(gridCols * gridRows, -1);
+    nextInCell.clear();
+    for (const cv::KeyPoint &candidate : candidates)
+    {
+        int cellX = candidate.pt.x / cellSize, cellY = candidate.pt.y / cellSize;
+        bool bOverlap = false;
+        for (int y = max(0, cellY - 1); y <= min(gridRows - 1, cellY + 1) && !bOverlap; y++)
         {
-            if(knn_matches[i][0].distance < knn_matches[i][1].distance * ratio_thresh)
+            for (int x = max(0, cellX - 1); x <= min(gridCols - 1, cellX + 1) && !bOverlap; x++)
             {
-                matches.push_back(knn_matches[i][0]);
+                for (int kept = cellHeads[y * gridCols + x]; kept >= 0 && !bOverlap; kept = nextInCell[kept])
+                {
+                    float dx = keypoints[kept].pt.x - candidate.pt.x, dy = keypoints[kept].pt.y - candidate.pt.y;
+                    bOverlap = dx * dx + dy * dy < cellSize * cellSize;
+                }
             }
         }
-        cout << "# keypoints removed = " << knn_matches.size() - matches.size() << endl;
+        if (!bOverlap)
+        {
+            int cell = cellY * gridCols + cellX;
+            nextInCell.push_back(cellHeads[cell]);
+            cellHeads[cell] = keypoints.size();
+            keypoints.push_back(candidate);
+        }
     }
 }
 
-// Use one of several types of state-of-art descriptors to uniquely identify keypoints
-void descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, string descriptorType)
+// names for console output, in enum order
+static const char *const detectorNames[] = {"SHITOMASI", "HARRIS", "FAST", "BRISK", "ORB", "AKAZE", "SIFT"};
+static const char *const descriptorNames[] = {"BRISK", "BRIEF", "ORB", "FREAK", "AKAZE", "SIFT"};
+
+// true if both lists hold the same keypoints in the same order
+static bool sameKeypoints(const vector<cv::KeyPoint> &a, const vector<cv::KeyPoint> &b)
 {
-    // select appropriate descriptor
-    cv::Ptr<cv::DescriptorExtractor> extractor;
-    double t ;
-    if (descriptorType.compare("BRISK") == 0)
+    if (a.size() != b.size())
     {
-        int threshold = 30;        // FAST/AGAST detection threshold score.
-        int octaves = 3;           // detection octaves (use 0 to do single scale)
-        float patternScale = 1.0f; // apply this scale to the pattern used for sampling the neighbourhood of a keypoint.
-        t = (double)cv::getTickCount();
-        extractor = cv::BRISK::create(threshold, octaves, patternScale);
-        extractor->compute(img ,keypoints ,descriptors );
-        t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-
+        return false;
     }
-    else if(descriptorType.compare("SIFT") == 0 )
-    {  
-        t = (double)cv::getTickCount();
-        extractor = cv::xfeatures2d::SIFT::create();
-        extractor->compute(img ,keypoints ,descriptors );
-        t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].pt.x != b[i].pt.x || a[i].pt.y != b[i].pt.y || a[i].size != b[i].size || a[i].angle != b[i].angle ||
+            a[i].octave != b[i].octave || a[i].class_id != b[i].class_id)
+        {
+            return false;
+        }
     }
-    else if(descriptorType.compare("ORB") == 0 )
-    { 
-        t = (double)cv::getTickCount();
-        extractor = cv::ORB::create();
-        extractor->compute(img ,keypoints,descriptors);
-        t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    return true;
+}
+
+FeaturePipeline::FeaturePipeline(DetectorType detectorType, DescriptorType descriptorType,
+                                 MatcherType matcherType, SelectorType selectorType)
+    : detectorType(detectorType), descriptorType(descriptorType), matcherType(matcherType), selectorType(selectorType),
+      fused(false), describedInDetect(false)
+{
+    switch (detectorType)
+    {
+    case DetectorType::FAST:
+    {
+        int threshold = 30;
+        bool bNMS = true;
+        detector = cv::FastFeatureDetector::create(threshold, bNMS, cv::FastFeatureDetector::TYPE_9_16);
+        break;
     }
-    else if(descriptorType.compare("AKAZE") == 0 )
-    { 
-        t = (double)cv::getTickCount();
-        extractor = cv::AKAZE::create();
-        extractor->compute(img ,keypoints,descriptors);
-        t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    case DetectorType::BRISK:
+        detector = cv::BRISK::create();
+        break;
+    case DetectorType::ORB:
+        detector = cv::ORB::create();
+        break;
+    case DetectorType::AKAZE:
+        detector = cv::AKAZE::create();
+        break;
+    case DetectorType::SIFT:
+        detector = cv::xfeatures2d::SIFT::create();
+        break;
+    case DetectorType::SHITOMASI:
+    case DetectorType::HARRIS:
+        break;
     }
-    else if(descriptorType.compare("BRIEF") == 0 )
-    { 
-        t = (double)cv::getTickCount();
-        extractor = cv::xfeatures2d::BriefDescriptorExtractor::create();
-        extractor->compute(img ,keypoints,descriptors);
-        t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+    // the same algorithm on both sides shares one object, the BRISK descriptor parameters below are the defaults
+    fused = (detectorType == DetectorType::BRISK && descriptorType == DescriptorType::BRISK) ||
+            (detectorType == DetectorType::ORB && descriptorType == DescriptorType::ORB) ||
+            (detectorType == DetectorType::AKAZE && descriptorType == DescriptorType::AKAZE) ||
+            (detectorType == DetectorType::SIFT && descriptorType == DescriptorType::SIFT);
+    if (fused)
+    {
+        extractor = detector;
+    }
+    else
+    {
+        switch (descriptorType)
+        {
+        case DescriptorType::BRISK:
+        {
+            int threshold = 30;        // FAST/AGAST detection threshold score.
+            int octaves = 3;           // detection octaves (use 0 to do single scale)
+            float patternScale = 1.0f; // apply this scale to the pattern used for sampling the neighbourhood of a keypoint.
+            extractor = cv::BRISK::create(threshold, octaves, patternScale);
+            break;
+        }
+        case DescriptorType::BRIEF:
+            extractor = cv::xfeatures2d::BriefDescriptorExtractor::create();
+            break;
+        case DescriptorType::ORB:
+            extractor = cv::ORB::create();
+            break;
+        case DescriptorType::FREAK:
+            extractor = cv::xfeatures2d::FREAK::create();
+            break;
+        case DescriptorType::AKAZE:
+            extractor = cv::AKAZE::create();
+            break;
+        case DescriptorType::SIFT:
+            extractor = cv::xfeatures2d::SIFT::create();
+            break;
+        }
     }
-    cout << descriptorType << " descriptor extraction in " << 1000 * t / 1.0 << " ms" << endl;
 
+    if (matcherType == MatcherType::MAT_BF)
+    {   // SIFT descriptors are floating point histograms, all others binary strings
+        int normType = descriptorType == DescriptorType::SIFT ? cv::NORM_L2 : cv::NORM_HAMMING;
+        bool crossCheck = false;
+        matcher = cv::BFMatcher::create(normType, crossCheck);
+    }
+    else
+    {
+        matcher = cv::FlannBasedMatcher::create();
+    }
 }
 
-// Detect keypoints in image using the traditional Shi-Thomasi detector
-void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img, bool bVis)
+void FeaturePipeline::detect(const cv::Mat &img, vector<cv::KeyPoint> &keypoints, const cv::Mat &mask, bool bVis)
 {
-    // compute detector parameters based on image size
-    int blockSize = 4;       //  size of an average block for computing a derivative covariation matrix over each pixel neighborhood
-    double maxOverlap = 0.0; // max. permissible overlap between two features in %
-    double minDistance = (1.0 - maxOverlap) * blockSize;
-    int maxCorners = img.rows * img.cols / max(1.0, minDistance); // max. num. of keypoints
-
-    double qualityLevel = 0.01; // minimal accepted quality of image corners
-    double k = 0.04;
-
-    // Apply corner detection
+    keypoints.clear();
     double t = (double)cv::getTickCount();
-    vector<cv::Point2f> corners;
-    cv::goodFeaturesToTrack(img, corners, maxCorners, qualityLevel, minDistance, cv::Mat(), blockSize, false, k);
-
-    // add corners to result vector
-    for (auto it = corners.begin(); it != corners.end(); ++it)
+    if (fused)
     {
-
-        cv::KeyPoint newKeyPoint;
-        newKeyPoint.pt = cv::Point2f((*it).x, (*it).y);
-        newKeyPoint.size = blockSize;
-        keypoints.push_back(newKeyPoint);
+        // release first, the descriptors handed out by the last describe must not be overwritten
+        fusedDescriptors.release();
+        detector->detectAndCompute(img, mask, keypoints, fusedDescriptors);
+        fusedKeypoints = keypoints;
+    }
+    else if (detectorType == DetectorType::SHITOMASI)
+    {
+        detectShiTomasi(img, mask, keypoints);
+    }
+    else if (detectorType == DetectorType::HARRIS)
+    {
+        harris.detect(img, keypoints, mask);
+    }
+    else
+    {
+        detector->detect(img, keypoints, mask);
     }
     t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << "Shi-Tomasi detection with n=" << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
-    // visualize results
+    const char *name = detectorNames[static_cast<int>(detectorType)];
+    cout << name << (fused ? " detection and description" : " detection") << " with n=" << keypoints.size()
+         << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
+
     if (bVis)
     {
         cv::Mat visImage = img.clone();
         cv::drawKeypoints(img, keypoints, visImage, cv::Scalar::all(-1), cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
-        string windowName = "Shi-Tomasi Corner Detector Results";
+        string windowName = string(name) + " Detector Results";
         cv::namedWindow(windowName, 6);
         imshow(windowName, visImage);
         cv::waitKey(0);
     }
 }
 
-void detKeypointsModern(vector<cv::KeyPoint> &keypoints, cv::Mat &img,string detectorType, bool bVis)
-{   
-    cv::Ptr<cv::FeatureDetector> Detector;
-    double t=0 ;
-    if(detectorType.compare("BRISK") == 0)   
-    {   
-        t = (double)cv::getTickCount();
-        Detector = cv::BRISK::create();
-        Detector->detect(img ,keypoints);
-        t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    }
-    else if(detectorType.compare("SIFT") == 0 )
-    {  
-        t = (double)cv::getTickCount();
-        Detector = cv::xfeatures2d::SIFT::create();
-        Detector->detect(img ,keypoints);
-        t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    }
-    else if(detectorType.compare("ORB") == 0 )
-    { 
-        t = (double)cv::getTickCount();
-        Detector = cv::ORB::create();
-        Detector->detect(img ,keypoints);
-        t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    }
-    else if(detectorType.compare("AKAZE") == 0 )
-    { 
-        t = (double)cv::getTickCount();
-        Detector = cv::AKAZE::create();
-        Detector->detect(img ,keypoints);
-        t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    }
-    else if(detectorType.compare("HARRIS") == 0 )
-    { 
-        t = (double)cv::getTickCount();
-        detKeypointsHarris(Detector ,keypoints,img , bVis);
-        t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    }
-    else if(detectorType.compare("FAST") == 0 )
-    {   
-        int threshold = 30;
-        bool bNMS = true;
-        cv::FastFeatureDetector::DetectorType type = cv::FastFeatureDetector::TYPE_9_16;
-        t = (double)cv::getTickCount();
-        Detector = cv::FastFeatureDetector::create(threshold,bNMS,type);
-        Detector->detect(img ,keypoints);        
-        t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    }
-    cout << detectorType <<" detection with n=" << keypoints.size() << " keypoints in " << 1000 * t / 1.0 << " ms" << endl;
-    if(bVis && detectorType.compare("HARRIS") !=0)
+void FeaturePipeline::describe(const cv::Mat &img, vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors)
+{
+    describedInDetect = fused && !fusedDescriptors.empty() && sameKeypoints(keypoints, fusedKeypoints);
+    if (describedInDetect)
     {
-    cv::Mat visimg = img.clone();
-    string windowname =  detectorType;
-    cv::namedWindow(windowname , 1);
-    cv::drawKeypoints(img ,keypoints,visimg);
-    cv::imshow(windowname,visimg);
-    cv::waitKey(0);
+        descriptors = fusedDescriptors;
+        fusedDescriptors.release();
+        cout << descriptorNames[static_cast<int>(descriptorType)] << " descriptors computed during detection" << endl;
+        return;
     }
-
+    double t = (double)cv::getTickCount();
+    extractor->compute(img, keypoints, descriptors);
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    cout << descriptorNames[static_cast<int>(descriptorType)] << " descriptor extraction in " << 1000 * t / 1.0 << " ms" << endl;
 }
-void detKeypointsHarris(cv::Ptr<cv::FeatureDetector> &Detector,std::vector<cv::KeyPoint> &Keys, cv::Mat &img, bool bVis)
-{
-    int blockSize = 2;     // for every pixel, a blockSize × blockSize neighborhood is considered
-    int apertureSize = 3;  // aperture parameter for Sobel operator (must be odd)
-    int minResponse = 100; // minimum value for a corner in the 8bit scaled response matrix
-    double k = 0.04;       // Harris parameter (see equation for details)
 
-    cv::Mat dst, dst_norm, dst_norm_scaled;
-    dst = cv::Mat::zeros(img.size(), CV_32FC1);
-    cv::cornerHarris(img, dst, blockSize, apertureSize, k, cv::BORDER_DEFAULT);
-    cv::normalize(dst, dst_norm, 0, 255, cv::NORM_MINMAX, CV_32FC1, cv::Mat());
-    cv::convertScaleAbs(dst_norm, dst_norm_scaled);
+void FeaturePipeline::match(const cv::Mat &descSource, const cv::Mat &descRef, vector<cv::DMatch> &matches)
+{
+    matches.clear();
+    const cv::Mat *source = &descSource;
+    const cv::Mat *ref = &descRef;
+    if (matcherType == MatcherType::MAT_FLANN && descSource.type() != CV_32F)
+    {   // OpenCV bug workaround : convert binary descriptors to floating point due to a bug in current OpenCV implementation,
+        // into the scratch buffers so the frame's own descriptors stay binary
+        descSource.convertTo(descSourceFloat, CV_32F);
+        descRef.convertTo(descRefFloat, CV_32F);
+        source = &descSourceFloat;
+        ref = &descRefFloat;
+    }
 
-    double maxOverlap = 0.0;
-    for (size_t j = 0; j < dst_norm.rows; j++)
-    {
-        for (size_t i = 0; i < dst_norm.cols; i++)
+    if (selectorType == SelectorType::SEL_NN)
+    { // nearest neighbor (best match)
+        matcher->match(*source, *ref, matches);
+    }
+    else
+    { // k nearest neighbors (k=2) with descriptor distance ratio filtering
+        matcher->knnMatch(*source, *ref, knnMatches, 2);
+        const float ratioThreshold = 0.8f;
+        for (size_t i = 0; i < knnMatches.size(); i++)
         {
-            int response = dst_norm.at<float>(j,i);
-            if(response > minResponse)
+            if (knnMatches[i].size() == 2 && knnMatches[i][0].distance < knnMatches[i][1].distance * ratioThreshold)
             {
-                cv::KeyPoint NewKeyPoint;
-                NewKeyPoint.pt = cv::Point2d(i,j);
-                NewKeyPoint.response = response;
-                NewKeyPoint.size = 2*apertureSize;
-
-                bool bOverlap = false;
-                
-                for(auto it = Keys.begin() ; it != Keys.end() ; it++)
-                {
-                    double KptOverlap = cv::KeyPoint::overlap(NewKeyPoint,*it);
-                    if(KptOverlap > maxOverlap)
-                    {
-                        bOverlap = true;
-                        if (NewKeyPoint.response > (*it).response)
-                        {                      // if overlap is >t AND response is higher for new kpt
-                            *it = NewKeyPoint; // replace old key point with new one
-                            break;             // quit loop over keypoints
-                        }
-                    }
-
-                }
-                if (!bOverlap)
-                {                                     // only add new key point if no overlap has been found in previous NMS
-                    Keys.push_back(NewKeyPoint); // store new keypoint in dynamic list
-                }
-
+                matches.push_back(knnMatches[i][0]);
             }
         }
+        cout << "# keypoints removed = " << knnMatches.size() - matches.size() << endl;
     }
+}
+
+void FeaturePipeline::detectShiTomasi(const cv::Mat &img, const cv::Mat &mask, vector<cv::KeyPoint> &keypoints)
+{
+    int blockSize = 4;       //  size of an average block for computing a derivative covariation matrix over each pixel neighborhood
+    double maxOverlap = 0.0; // max. permissible overlap between two features in %
+    double minDistance = (1.0 - maxOverlap) * blockSize;
+    int maxCorners = img.rows * img.cols / max(1.0, minDistance); // max. num. of keypoints
 
-    if(bVis)
+    double qualityLevel = 0.01; // minimal accepted quality of image corners
+    double k = 0.04;
+
+    cv::goodFeaturesToTrack(img, corners, maxCorners, qualityLevel, minDistance, mask, blockSize, false, k);
+    keypoints.reserve(corners.size());
+    for (auto it = corners.begin(); it != corners.end(); ++it)
     {
-    std::string windowName = "Harris Corner Detection Results";
-    cv::namedWindow(windowName, 5);
-    cv::Mat visImage = dst_norm_scaled.clone();
-    cv::drawKeypoints(dst_norm_scaled, Keys, visImage, cv::Scalar::all(-1), cv::DrawMatchesFlags::DRAW_RICH_KEYPOINTS);
-    cv::imshow(windowName, visImage);
-    cv::waitKey(0);
+        cv::KeyPoint newKeyPoint;
+        newKeyPoint.pt = *it;
+        newKeyPoint.size = blockSize;
+        keypoints.push_back(newKeyPoint);
     }
 }
@@ -0,0 +1,247 @@
+// Streaming obstacle detection over azimuth wedges.
+// Each wedge is filtered, ground segmented and clustered as soon as it arrives
+// instead of waiting for the full 360 degree scan. Clusters that run into the
+// trailing edge of a wedge are held back and stitched onto the clusters of the
+// next wedge, everything else is reported right away. Wedge 0 is centred on +x
+// so obstacles straight ahead come out first.
+
+#ifndef AZIMUTHSLICES_H_
+#define AZIMUTHSLICES_H_
+
+#include "processPointClouds.h"
+#include "ikdtree.h"
+#include <limits>
+
+template<typename PointT>
+struct AzimuthSliceStream
+{
+    typedef typename pcl::PointCloud<PointT>::Ptr CloudPtr;
+
+    struct OpenCluster
+    {
+        CloudPtr cloud;
+        // touches the start edge of wedge 0, has to wait for the last wedge to close the circle
+        bool atScanStart;
+    };
+
+    ProcessPointClouds<PointT>* processor;
+    int numSlices;
+    float startAngle;
+
+    // filtering, segmentation and clustering parameters, same meaning as in cityBlock
+    float filterRes;
+    Eigen::Vector4f minPoint;
+    Eigen::Vector4f maxPoint;
+    int maxIterations;
+    float distanceThreshold;
+    // with normals only points on a near-horizontal surface can count as road
+    bool useNormals;
+    int normalNeighbours;
+    float maxNormalAngle;
+    float clusterTolerance;
+    int minSize;
+    int maxSize;
+
+    // clusters that may still continue into the next wedge
+    std::vector<OpenCluster> open;
+    int nextSlice;
+
+    AzimuthSliceStream(ProcessPointClouds<PointT>* setProcessor, int setNumSlices)
+    :   processor(setProcessor), numSlices(setNumSlices), startAngle(-M_PI / setNumSlices),
+        filterRes(0.5f), minPoint(-10, -5, -2, 1), maxPoint(30, 8, 1, 1),
+        maxIterations(100), distanceThreshold(0.2), useNormals(false), normalNeighbours(10), maxNormalAngle(0.35),
+        clusterTolerance(0.5), minSize(30), maxSize(250),
+        nextSlice(0)
+    {}
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    double sliceAngle(int slice) const
+    {
+        return startAngle + 2 * M_PI * slice / numSlices;
+    }
+
+    // drop whatever is left of an unfinished scan
+    void reset()
+    {
+        open.clear();
+        nextSlice = 0;
+    }
+
+    // process the next wedge of the scan. Clusters completed by this wedge are appended to clusters,
+    // the wedge's obstacle and ground points are returned like SegmentPlane does.
+    // After the last wedge the stream is reset for the next scan.
+    std::pair<CloudPtr, CloudPtr> addSlice(CloudPtr slice, std::vector<CloudPtr>& clusters)
+    {
+        int index = nextSlice++;
+
+        CloudPtr filtered = processor->FilterCloud(slice, filterRes, minPoint, maxPoint);
+        std::pair<CloudPtr, CloudPtr> segmented;
+        if(filtered->points.size() < 3)
+            segmented = std::make_pair(filtered, CloudPtr(new pcl::PointCloud<PointT>)); // too few points to fit a plane
+        else if(useNormals)
+        {
+            std::vector<Eigen::Vector3f> normals = processor->EstimateNormals(filtered, normalNeighbours);
+            segmented = processor->RANSAC3D(filtered, maxIterations, distanceThreshold, normals, maxNormalAngle);
+        }
+        else
+            segmented = processor->RANSAC3D(filtered, maxIterations, distanceThreshold);
+
+        // size limits are applied after stitching, a cluster cut by an edge can be small on either side
+        IKdTree<PointT> tree;
+        tree.insert(segmented.first->points, 0);
+        std::vector<CloudPtr> fresh = processor->euclideanCluster(segmented.first, tree, clusterTolerance, 1, std::numeric_limits<int>::max());
+
+        std::vector<OpenCluster> candidates = open;
+        for(CloudPtr cluster : fresh)
+        {
+            OpenCluster candidate;
+            candidate.cloud = cluster;
+            candidate.atScanStart = (index == 0 && touchesEdge(cluster, sliceAngle(0)));
+            candidates.push_back(candidate);
+        }
+
+        // stitch new clusters onto the open ones across the shared edge
+        std::vector<int> parent(candidates.size());
+        for(size_t i = 0; i < parent.size(); i++)
+            parent[i] = i;
+        for(size_t i = open.size(); i < candidates.size(); i++)
+        {
+            for(size_t j = 0; j < open.size(); j++)
+            {
+                if(nearAcrossEdge(candidates[i].cloud, candidates[j].cloud, sliceAngle(index)))
+                    unite(parent, i, j);
+            }
+        }
+        std::vector<OpenCluster> merged = mergeGroups(candidates, parent);
+
+        bool lastSlice = (index == numSlices - 1);
+        if(lastSlice)
+        {
+            // the end edge of the last wedge is the start edge of wedge 0, close the circle
+            parent.resize(merged.size());
+            for(size_t i = 0; i < parent.size(); i++)
+                parent[i] = i;
+            for(size_t i = 0; i < merged.size(); i++)
+            {
+                for(size_t j = 0; j < merged.size(); j++)
+                {
+                    if(merged[i].atScanStart && !merged[j].atScanStart && nearAcrossEdge(merged[i].cloud, merged[j].cloud, sliceAngle(numSlices)))
+                        unite(parent, i, j);
+                }
+            }
+            merged = mergeGroups(merged, parent);
+        }
+
+        open.clear();
+        for(const OpenCluster& cluster : merged)
+        {
+            bool pending = !lastSlice && (cluster.atScanStart || touchesEdge(cluster.cloud, sliceAngle(index + 1)));
+            if(pending)
+                open.push_back(cluster);
+            else if(cluster.cloud->points.size() >= minSize && cluster.cloud->points.size() <= maxSize)
+                clusters.push_back(cluster.cloud);
+        }
+
+        if(lastSlice)
+            reset();
+
+        return segmented;
+    }
+
+private:
+    // distance of a point from the half plane through the z axis at azimuth atan2(s, c)
+    float edgeDistance(const PointT& point, float c, float s) const
+    {
+        if(c * point.x + s * point.y < -clusterTolerance)
+            return std::numeric_limits<float>::max();
+        return fabs(-s * point.x + c * point.y);
+    }
+
+    bool touchesEdge(CloudPtr cluster, double angle) const
+    {
+        float c = cos(angle);
+        float s = sin(angle);
+        for(const PointT& point : cluster->points)
+        {
+            if(edgeDistance(point, c, s) <= clusterTolerance)
+                return true;
+        }
+        return false;
+    }
+
+    // true if the two clusters have points within clusterTolerance of each other close to the edge
+    bool nearAcrossEdge(CloudPtr a, CloudPtr b, double angle) const
+    {
+        float c = cos(angle);
+        float s = sin(angle);
+        float tolSq = clusterTolerance * clusterTolerance;
+        for(const PointT& pa : a->points)
+        {
+            if(edgeDistance(pa, c, s) > clusterTolerance)
+                continue;
+            for(const PointT& pb : b->points)
+            {
+                if(edgeDistance(pb, c, s) > clusterTolerance)
+                    continue;
+                float dx = pa.x - pb.x;
+                float dy = pa.y - pb.y;
+                float dz = pa.z - pb.z;
+                if(dx * dx + dy * dy + dz * dz <= tolSq)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    static int find(std::vector<int>& parent, int i)
+    {
+        while(parent[i] != i)
+        {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    static void unite(std::vector<int>& parent, int a, int b)
+    {
+        parent[find(parent, a)] = find(parent, b);
+    }
+
+    static std::vector<OpenCluster> mergeGroups(const std::vector<OpenCluster>& clusters, std::vector<int>& parent)
+    {
+        std::vector<int> groupSize(clusters.size(), 0);
+        for(size_t i = 0; i < clusters.size(); i++)
+            groupSize[find(parent, i)]++;
+
+        std::vector<OpenCluster> merged;
+        std::vector<int> slot(clusters.size(), -1);
+        for(size_t i = 0; i < clusters.size(); i++)
+        {
+            int root = find(parent, i);
+            if(groupSize[root] == 1)
+            {
+                // nothing to stitch, keep the cloud as it is
+                merged.push_back(clusters[i]);
+                continue;
+            }
+            if(slot[root] < 0)
+            {
+                slot[root] = merged.size();
+                OpenCluster cluster;
+                cluster.cloud = CloudPtr(new pcl::PointCloud<PointT>);
+                cluster.atScanStart = false;
+                merged.push_back(cluster);
+            }
+            OpenCluster& target = merged[slot[root]];
+            target.cloud->points.insert(target.cloud->points.end(), clusters[i].cloud->points.begin(), clusters[i].cloud->points.end());
+            target.cloud->width = target.cloud->points.size();
+            target.cloud->height = 1;
+            target.atScanStart |= clusters[i].atScanStart;
+        }
+        return merged;
+    }
+};
+
+#endif /* AZIMUTHSLICES_H_ */
@@ -7,6 +7,9 @@
 #include "processPointClouds.h"
 // using templates for processPointClouds so also include .cpp to help linker
 #include "processPointClouds.cpp"
+#include "ikdtree.h"
+#include "azimuthSlices.h"
+#include "quantizedCloud.h"
 
 std::vector<Car> initHighway(bool renderScene, pcl::visualization::PCLVisualizer::Ptr& viewer)
 {
@@ -147,14 +150,22 @@ void cityBlock(pcl::visualization::PCLVisualizer::Ptr& viewer, ProcessPointCloud
         }
 }
 */
-void cityBlock(pcl::visualization::PCLVisualizer::Ptr& viewer, ProcessPointClouds<pcl::PointXYZI>* pointProcessorI, const pcl::PointCloud<pcl::PointXYZI>::Ptr& inputCloud){
+// with useNormals only points on a near-horizontal surface can count as road
+void cityBlock(pcl::visualization::PCLVisualizer::Ptr& viewer, ProcessPointClouds<pcl::PointXYZI>* pointProcessorI, const pcl::PointCloud<pcl::PointXYZI>::Ptr& inputCloud, bool useNormals){
     pcl::PointCloud<pcl::PointXYZI>::Ptr FilterCloud = pointProcessorI->FilterCloud(inputCloud , 0.5f , Eigen::Vector4f  (-10,-5,-2,1) , Eigen::Vector4f (30,8,1,1));
-    std::pair<pcl::PointCloud<pcl::PointXYZI>::Ptr, pcl::PointCloud<pcl::PointXYZI>::Ptr> segmentCloud = pointProcessorI->RANSAC3D(FilterCloud, 100, 0.2);
-  KdTree* tree = new KdTree;
+    std::pair<pcl::PointCloud<pcl::PointXYZI>::Ptr, pcl::PointCloud<pcl::PointXYZI>::Ptr> segmentCloud;
+    if(useNormals)
+    {
+        std::vector<Eigen::Vector3f> normals = pointProcessorI->EstimateNormals(FilterCloud, 10);
+        segmentCloud = pointProcessorI->RANSAC3D(FilterCloud, 100, 0.2, normals, 0.35);
+    }
+    else
+        segmentCloud = pointProcessorI->RANSAC3D(FilterCloud, 100, 0.2);
+  KdTree tree;
   
   for (int i=0; i<segmentCloud.first->points.size(); i++) 
-    tree->insert(segmentCloud.first->points[i],i);
-  std::vector<pcl::PointCloud<pcl::PointXYZI>::Ptr> cloudClusters = pointProcessorI->euclideanCluster(segmentCloud.first, tree, 0.5, 30, 250);
+    tree.insert(segmentCloud.first->points[i],i);
+  std::vector<pcl::PointCloud<pcl::PointXYZI>::Ptr> cloudClusters = pointProcessorI->euclideanCluster(segmentCloud.first, &tree, 0.5, 30, 250);
 
   renderPointCloud(viewer,segmentCloud.second, "planefield", Color(1,1,1));
   renderPointCloud(viewer,segmentCloud.first, "obsfield", Color(1,1,0));
@@ -175,20 +186,199 @@ void cityBlock(pcl::visualization::PCLVisualizer::Ptr& viewer, ProcessPointCloud
   }
 }
 
+// Same as cityBlock but one azimuth wedge at a time, so clusters are rendered as soon as they are complete
+void cityBlockStreaming(pcl::visualization::PCLVisualizer::Ptr& viewer, ProcessPointClouds<pcl::PointXYZI>* pointProcessorI, const pcl::PointCloud<pcl::PointXYZI>::Ptr& inputCloud, AzimuthSliceStream<pcl::PointXYZI>& sliceStream)
+{
+    // recorded scans come in whole, cut them up the way the sensor would hand them over
+    std::vector<pcl::PointCloud<pcl::PointXYZI>::Ptr> slices = pointProcessorI->SplitAzimuth(inputCloud, sliceStream.numSlices, sliceStream.startAngle);
+
+    auto startTime = std::chrono::steady_clock::now();
+    int clusterId = 0;
+    std::vector<Color> colors = {Color(1,0,0), Color(0,1,0), Color(0,0,1)};
+    for(int i = 0; i < slices.size(); i++)
+    {
+        std::vector<pcl::PointCloud<pcl::PointXYZI>::Ptr> cloudClusters;
+        std::pair<pcl::PointCloud<pcl::PointXYZI>::Ptr, pcl::PointCloud<pcl::PointXYZI>::Ptr> segmentCloud = sliceStream.addSlice(slices[i], cloudClusters);
+        renderPointCloud(viewer,segmentCloud.second, "planefield"+std::to_string(i), Color(1,1,1));
+        renderPointCloud(viewer,segmentCloud.first, "obsfield"+std::to_string(i), Color(1,1,0));
+
+        auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+        for(pcl::PointCloud<pcl::PointXYZI>::Ptr cluster : cloudClusters)
+        {
+            std::cout << "cluster of " << cluster->points.size() << " points ready after wedge " << i << ", " << elapsedTime.count() << " milliseconds into the scan" << std::endl;
+            renderPointCloud(viewer,cluster,"obstCloud"+std::to_string(clusterId),colors[clusterId % colors.size()]);
+
+            Box box = pointProcessorI->BoundingBox(cluster);
+            renderBox(viewer,box,clusterId , Color(0,1,1));
+            ++clusterId;
+        }
+    }
+}
+
+// Simulated highway where the lidar hands over every azimuth wedge as soon as its rays are cast,
+// so obstacles in the first wedges are clustered while the rest of the scan is still being cast
+void highwayStreaming(pcl::visualization::PCLVisualizer::Ptr& viewer, bool useNormals)
+{
+    std::vector<Car> cars = initHighway(true, viewer);
+    // the roof lidar reports in the vehicle frame, the bumper lidar in its own frame
+    Lidar roofLidar(cars, 0);
+    Vect3 bumperMount(2.3, 0, 0.8);
+    Lidar bumperLidar(cars, 0, bumperMount, bumperMount);
+    std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> > extrinsics = {roofLidar.extrinsic(), bumperLidar.extrinsic()};
+    ProcessPointClouds<pcl::PointXYZ> pointProcessor;
+    AzimuthSliceStream<pcl::PointXYZ> sliceStream(&pointProcessor, 8);
+    // simulated points are sparse and in the world frame, with the road at z = 0
+    sliceStream.filterRes = 0.2f;
+    sliceStream.minPoint = Eigen::Vector4f(-50, -10, -1, 1);
+    sliceStream.maxPoint = Eigen::Vector4f(50, 10, 3, 1);
+    sliceStream.clusterTolerance = 1.0;
+    sliceStream.minSize = 3;
+    sliceStream.maxSize = 500;
+    sliceStream.useNormals = useNormals;
+
+    auto startTime = std::chrono::steady_clock::now();
+    int clusterId = 0;
+    std::vector<Color> colors = {Color(1,0,0), Color(0,1,0), Color(0,0,1)};
+    for(int i = 0; i < sliceStream.numSlices; i++)
+    {
+        std::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr> sensorWedges = {roofLidar.scanWedge(sliceStream.sliceAngle(i), sliceStream.sliceAngle(i + 1)),
+                                                                          bumperLidar.scanWedge(sliceStream.sliceAngle(i), sliceStream.sliceAngle(i + 1))};
+        // merge into the vehicle frame before the slice is filtered
+        pcl::PointCloud<pcl::PointXYZ>::Ptr wedge = pointProcessor.MergeClouds(sensorWedges, extrinsics, 0.1f);
+        std::vector<pcl::PointCloud<pcl::PointXYZ>::Ptr> cloudClusters;
+        std::pair<pcl::PointCloud<pcl::PointXYZ>::Ptr, pcl::PointCloud<pcl::PointXYZ>::Ptr> segmentCloud = sliceStream.addSlice(wedge, cloudClusters);
+        renderPointCloud(viewer,segmentCloud.second, "planefield"+std::to_string(i), Color(1,1,1));
+        renderPointCloud(viewer,segmentCloud.first, "obsfield"+std::to_string(i), Color(1,1,0));
+
+        auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+        for(pcl::PointCloud<pcl::PointXYZ>::Ptr cluster : cloudClusters)
+        {
+            std::cout << "cluster of " << cluster->points.size() << " points ready after wedge " << i << " of " << sliceStream.numSlices
+                      << ", " << elapsedTime.count() << " milliseconds into the scan" << std::endl;
+            renderPointCloud(viewer,cluster,"obstCloud"+std::to_string(clusterId),colors[clusterId % colors.size()]);
+
+            Box box = pointProcessor.BoundingBox(cluster);
+            renderBox(viewer,box,clusterId , Color(0,1,1));
+            ++clusterId;
+        }
+    }
+    // every wedge of the scan is cast
+    roofLidar.scanCount++;
+    bumperLidar.scanCount++;
+}
+
+// Keep the obstacle points of the last few frames in a rolling map and compare the
+// incremental update against rebuilding a KdTree over the whole window every frame.
+// The raw window is kept quantized and decoded for the rebuild, decoding is timed on its own
+void rollingMap(ProcessPointClouds<pcl::PointXYZI>* pointProcessorI, const pcl::PointCloud<pcl::PointXYZI>::Ptr& inputCloud, SlidingWindowMap<pcl::PointXYZI>& map, QuantizedHistory<>& history)
+{
+    pcl::PointCloud<pcl::PointXYZI>::Ptr FilterCloud = pointProcessorI->FilterCloud(inputCloud , 0.5f , Eigen::Vector4f  (-10,-5,-2,1) , Eigen::Vector4f (30,8,1,1));
+    std::pair<pcl::PointCloud<pcl::PointXYZI>::Ptr, pcl::PointCloud<pcl::PointXYZI>::Ptr> segmentCloud = pointProcessorI->RANSAC3D(FilterCloud, 100, 0.2);
+
+    auto startTime = std::chrono::steady_clock::now();
+    map.addFrame(segmentCloud.first->points);
+    auto endTime = std::chrono::steady_clock::now();
+    auto incrementalTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+
+    startTime = std::chrono::steady_clock::now();
+    history.push(segmentCloud.first->points, Eigen::Vector3f::Zero());
+    endTime = std::chrono::steady_clock::now();
+    auto encodeTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+
+    // decode the window up front, so the rebuild below times only the tree build
+    startTime = std::chrono::steady_clock::now();
+    std::vector<pcl::PointCloud<pcl::PointXYZI> > decoded(history.frames.size());
+    for(size_t frame = 0; frame < history.frames.size(); frame++)
+        history.frames[frame].decodeTo(decoded[frame].points);
+    endTime = std::chrono::steady_clock::now();
+    auto decodeTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+
+    startTime = std::chrono::steady_clock::now();
+    auto rebuildTime = std::chrono::microseconds(0);
+    {
+        KdTree tree;
+        int id = 0;
+        for(const pcl::PointCloud<pcl::PointXYZI>& frame : decoded)
+        {
+            for(size_t i = 0; i < frame.points.size(); i++)
+                tree.insert(frame.points[i], id++);
+        }
+        endTime = std::chrono::steady_clock::now();
+        rebuildTime = std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime);
+    }
+
+    std::cout << "rolling map of " << map.tree.size() << " points: incremental update took " << incrementalTime.count()
+              << " microseconds, full rebuild took " << rebuildTime.count() << " microseconds (" << map.tree.rebuildCount << " partial rebuilds so far)" << std::endl;
+    std::cout << "quantized history of " << history.size() << " points takes " << history.memoryBytes() << " bytes instead of "
+              << history.size() * sizeof(pcl::PointXYZI) << " as pcl::PointXYZI, encoding took " << encodeTime.count()
+              << " microseconds, decoding the window for the rebuild " << decodeTime.count() << " microseconds" << std::endl;
+}
+
 int main (int argc, char** argv)
 {
     std::cout << "starting enviroment" << std::endl;
 
+    // every option is off by default, the recorded scans are then played back through cityBlock
+    //   highway        stream the simulated lidar wedge by wedge instead of playing back recorded scans
+    //   --stream       process each recorded scan in azimuth wedges instead of waiting for the full cloud
+    //   --normals      only points on a near-horizontal surface can count as road
+    //   --rolling-map  benchmark the incremental kd-tree on a rolling map of the last 10 frames, without the viewer
+    bool highway = false;
+    bool streamSlices = false;
+    bool useNormals = false;
+    bool benchmarkRollingMap = false;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if(option == "highway")
+            highway = true;
+        else if(option == "--stream")
+            streamSlices = true;
+        else if(option == "--normals")
+            useNormals = true;
+        else if(option == "--rolling-map")
+            benchmarkRollingMap = true;
+        else
+        {
+            std::cerr << "usage: environment [highway] [--stream] [--normals] [--rolling-map]" << std::endl;
+            return 1;
+        }
+    }
+
+    ProcessPointClouds<pcl::PointXYZI>* pointProcessorI = new ProcessPointClouds<pcl::PointXYZI>();
+    std::vector<boost::filesystem::path> stream = pointProcessorI->streamPcd("../src/sensors/data/pcd/data_1");
+
+    if(benchmarkRollingMap)
+    {
+        SlidingWindowMap<pcl::PointXYZI> rollingWindow(10);
+        // the raw frames of the window, 1 cm int16 coordinates relative to the ego vehicle
+        QuantizedHistory<> rollingHistory(rollingWindow.windowSize, 0.01f, 1.0f);
+        for(const boost::filesystem::path& file : stream)
+            rollingMap(pointProcessorI, pointProcessorI->loadPcd(file.string()), rollingWindow, rollingHistory);
+        delete pointProcessorI;
+        return 0;
+    }
+
     pcl::visualization::PCLVisualizer::Ptr viewer (new pcl::visualization::PCLVisualizer ("3D Viewer"));
     CameraAngle setAngle = XY;
     initCamera(setAngle, viewer);
     //simpleHighway(viewer);
     //cityBlock(viewer);
 
-    ProcessPointClouds<pcl::PointXYZI>* pointProcessorI = new ProcessPointClouds<pcl::PointXYZI>();
-    std::vector<boost::filesystem::path> stream = pointProcessorI->streamPcd("../src/sensors/data/pcd/data_1");
+    if(highway)
+    {
+        highwayStreaming(viewer, useNormals);
+        while (!viewer->wasStopped ())
+            viewer->spinOnce ();
+        delete pointProcessorI;
+        return 0;
+    }
+
     auto streamIterator = stream.begin();
     pcl::PointCloud<pcl::PointXYZI>::Ptr inputCloudI;
+
+    AzimuthSliceStream<pcl::PointXYZI> sliceStream(pointProcessorI, 8);
+    sliceStream.useNormals = useNormals;
     
 
 
@@ -207,7 +397,10 @@ int main (int argc, char** argv)
 
     // Load pcd and run obstacle detection process
     inputCloudI = pointProcessorI->loadPcd((*streamIterator).string());
-    cityBlock(viewer, pointProcessorI, inputCloudI);
+    if(streamSlices)
+        cityBlockStreaming(viewer, pointProcessorI, inputCloudI, sliceStream);
+    else
+        cityBlock(viewer, pointProcessorI, inputCloudI, useNormals);
 
     streamIterator++;
     if(streamIterator == stream.end())
@@ -0,0 +1,526 @@
+// Incremental kd-tree for rolling multi-frame maps.
+// Unlike KdTree it can drop points again: deletions are lazy (nodes are only
+// flagged) and subtrees are rebuilt on their own once they get unbalanced or
+// carry too many deleted nodes, so a sliding window of frames can be kept
+// without rebuilding the whole tree every frame.
+
+#ifndef IKDTREE_H_
+#define IKDTREE_H_
+
+#include <vector>
+#include <deque>
+#include <queue>
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <Eigen/Core>
+#include "parallel.h"
+
+template<typename PointT>
+inline float pointCoord(const PointT& point, int axis)
+{
+    return axis == 0 ? point.x : (axis == 1 ? point.y : point.z);
+}
+
+template<typename PointT>
+struct IKdNode
+{
+    PointT point;
+    int id;
+    int axis;
+    bool deleted;
+    // number of nodes in this subtree (deleted ones included) and how many of them are deleted
+    int size;
+    int invalid;
+    // bounds of every point stored in this subtree, used to prune searches and box deletes
+    float min[3];
+    float max[3];
+    IKdNode* left;
+    IKdNode* right;
+    IKdNode* parent;
+
+    IKdNode(const PointT& setPoint, int setId, int setAxis, IKdNode* setParent)
+    :   point(setPoint), id(setId), axis(setAxis), deleted(false), size(1), invalid(0),
+        left(NULL), right(NULL), parent(setParent)
+    {
+        for(int i = 0; i < 3; i++)
+            min[i] = max[i] = pointCoord(point, i);
+    }
+
+    void extend(const PointT& p)
+    {
+        for(int i = 0; i < 3; i++)
+        {
+            float c = pointCoord(p, i);
+            if(c < min[i]) min[i] = c;
+            if(c > max[i]) max[i] = c;
+        }
+    }
+
+    // squared distance from a point to the bounds of this subtree
+    float boxDistanceSq(const PointT& p) const
+    {
+        float distSq = 0;
+        for(int i = 0; i < 3; i++)
+        {
+            float c = pointCoord(p, i);
+            float d = c < min[i] ? min[i] - c : (c > max[i] ? c - max[i] : 0);
+            distSq += d * d;
+        }
+        return distSq;
+    }
+};
+
+template<typename PointT>
+struct IKdTree
+{
+    typedef IKdNode<PointT> Node;
+
+    Node* root;
+    // a subtree is rebuilt when one child holds more than balanceAlpha of its nodes,
+    // or more than deleteBeta of its nodes are deleted
+    float balanceAlpha;
+    float deleteBeta;
+    int minRebuildSize;
+    // live ids only, deleted nodes are dropped from here straight away
+    std::unordered_map<int, Node*> nodes;
+    // number of partial rebuilds done so far, handy when tuning alpha/beta
+    int rebuildCount;
+
+    IKdTree(float setAlpha = 0.7f, float setBeta = 0.5f, int setMinRebuildSize = 16)
+    :   root(NULL), balanceAlpha(setAlpha), deleteBeta(setBeta), minRebuildSize(setMinRebuildSize), rebuildCount(0)
+    {}
+
+    ~IKdTree()
+    {
+        freeHelper(root);
+    }
+
+    IKdTree(const IKdTree&) = delete;
+    IKdTree& operator=(const IKdTree&) = delete;
+
+    int size() const
+    {
+        return nodes.size();
+    }
+
+    void clear()
+    {
+        freeHelper(root);
+        root = NULL;
+        nodes.clear();
+    }
+
+    // insert a single point, rebalancing the affected subtree right away
+    void insert(const PointT& point, int id)
+    {
+        Node* leaf = insertHelper(point, id);
+        std::vector<Node*> touched(1, leaf);
+        rebalance(touched);
+    }
+
+    // batched insert of points[i] with id firstId + i, the balance check runs once for the whole batch
+    template<typename PointVec>
+    void insert(const PointVec& points, int firstId)
+    {
+        if(points.empty())
+            return;
+
+        if(root == NULL)
+        {
+            // empty tree, build it balanced in one go
+            std::vector<Node*> fresh;
+            fresh.reserve(points.size());
+            for(size_t i = 0; i < points.size(); i++)
+            {
+                Node* node = new Node(points[i], firstId + i, 0, NULL);
+                nodes[node->id] = node;
+                fresh.push_back(node);
+            }
+            root = build(fresh, 0, fresh.size(), NULL);
+            return;
+        }
+
+        std::vector<Node*> touched;
+        touched.reserve(points.size());
+        for(size_t i = 0; i < points.size(); i++)
+            touched.push_back(insertHelper(points[i], firstId + i));
+        rebalance(touched);
+    }
+
+    // lazy delete by id, returns false if the id is not in the tree
+    bool remove(int id)
+    {
+        Node* node = markDeleted(id);
+        if(node == NULL)
+            return false;
+        std::vector<Node*> touched(1, node);
+        rebalance(touched);
+        return true;
+    }
+
+    // lazy delete of ids [firstId, firstId + count), e.g. a whole frame leaving the window
+    int remove(int firstId, int count)
+    {
+        std::vector<Node*> touched;
+        for(int id = firstId; id < firstId + count; id++)
+        {
+            Node* node = markDeleted(id);
+            if(node != NULL)
+                touched.push_back(node);
+        }
+        rebalance(touched);
+        return touched.size();
+    }
+
+    // lazy delete of every point inside the box, returns the number of points removed
+    int removeBox(Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint)
+    {
+        std::vector<Node*> touched;
+        removeBoxHelper(root, minPoint, maxPoint, touched);
+        rebalance(touched);
+        return touched.size();
+    }
+
+    // return a list of point ids in the tree that are within distance of pivot
+    std::vector<int> search(const PointT& pivot, float distanceTol) const
+    {
+        std::vector<int> ids;
+        searchHelper(pivot, root, distanceTol * distanceTol, ids);
+        return ids;
+    }
+
+    // return the ids of the k nearest points to pivot, closest first
+    std::vector<int> nearest(const PointT& pivot, int k) const
+    {
+        std::priority_queue<std::pair<float, int> > best;
+        if(k > 0)
+            nearestHelper(pivot, root, k, best);
+
+        std::vector<int> ids(best.size());
+        for(int i = ids.size() - 1; i >= 0; i--)
+        {
+            ids[i] = best.top().second;
+            best.pop();
+        }
+        return ids;
+    }
+
+    // batched k-nearest search over numThreads threads (0 uses every core), queries only read the tree.
+    // ids[i*k, i*k+k) holds the neighbours of queries[i], closest first, padded with -1 when the tree is smaller than k
+    template<typename PointVec>
+    void nearest(const PointVec& queries, int k, std::vector<int>& ids, int numThreads = 0) const
+    {
+        ids.assign(queries.size() * k, -1);
+        if(k <= 0)
+            return;
+
+        parallelFor(queries.size(), numThreads, [&](size_t begin, size_t end)
+        {
+            std::priority_queue<std::pair<float, int> > best;
+            for(size_t q = begin; q < end; q++)
+            {
+                nearestHelper(queries[q], root, k, best);
+                for(int i = best.size() - 1; i >= 0; i--)
+                {
+                    ids[q * k + i] = best.top().second;
+                    best.pop();
+                }
+            }
+        });
+    }
+
+private:
+    static int sizeOf(const Node* node)
+    {
+        return node == NULL ? 0 : node->size;
+    }
+
+    static void freeHelper(Node* node)
+    {
+        if(node == NULL)
+            return;
+        freeHelper(node->left);
+        freeHelper(node->right);
+        delete node;
+    }
+
+    bool needsRebuild(const Node* node) const
+    {
+        if(node->size < minRebuildSize)
+            return false;
+        int larger = std::max(sizeOf(node->left), sizeOf(node->right));
+        return larger > balanceAlpha * node->size || node->invalid > deleteBeta * node->size;
+    }
+
+    Node* insertHelper(const PointT& point, int id)
+    {
+        // an id that is already present is replaced
+        markDeleted(id);
+
+        Node* node = new Node(point, id, 0, NULL);
+        nodes[id] = node;
+        if(root == NULL)
+        {
+            root = node;
+            return node;
+        }
+
+        Node* current = root;
+        while(true)
+        {
+            current->size++;
+            current->extend(point);
+            Node*& child = pointCoord(point, current->axis) < pointCoord(current->point, current->axis) ? current->left : current->right;
+            if(child == NULL)
+            {
+                node->axis = (current->axis + 1) % 3;
+                node->parent = current;
+                child = node;
+                return node;
+            }
+            current = child;
+        }
+    }
+
+    Node* markDeleted(int id)
+    {
+        typename std::unordered_map<int, Node*>::iterator it = nodes.find(id);
+        if(it == nodes.end())
+            return NULL;
+        Node* node = it->second;
+        nodes.erase(it);
+        node->deleted = true;
+        for(Node* ancestor = node; ancestor != NULL; ancestor = ancestor->parent)
+            ancestor->invalid++;
+        return node;
+    }
+
+    int removeBoxHelper(Node* node, const Eigen::Vector4f& minPoint, const Eigen::Vector4f& maxPoint, std::vector<Node*>& touched)
+    {
+        if(node == NULL || node->invalid == node->size)
+            return 0;
+        for(int i = 0; i < 3; i++)
+        {
+            if(node->max[i] < minPoint[i] || node->min[i] > maxPoint[i])
+                return 0;
+        }
+
+        int removed = 0;
+        if(!node->deleted)
+        {
+            bool inside = true;
+            for(int i = 0; i < 3; i++)
+            {
+                float c = pointCoord(node->point, i);
+                inside &= (c >= minPoint[i] && c <= maxPoint[i]);
+            }
+            if(inside)
+            {
+                node->deleted = true;
+                nodes.erase(node->id);
+                touched.push_back(node);
+                removed++;
+            }
+        }
+        removed += removeBoxHelper(node->left, minPoint, maxPoint, touched);
+        removed += removeBoxHelper(node->right, minPoint, maxPoint, touched);
+        node->invalid += removed;
+        return removed;
+    }
+
+    // rebuild the topmost subtree that violates the balance criterion on the path of every touched node
+    void rebalance(const std::vector<Node*>& touched)
+    {
+        std::vector<Node*> candidates;
+        for(Node* node : touched)
+        {
+            Node* topmost = NULL;
+            for(Node* ancestor = node; ancestor != NULL; ancestor = ancestor->parent)
+            {
+                if(needsRebuild(ancestor))
+                    topmost = ancestor;
+            }
+            if(topmost != NULL)
+                candidates.push_back(topmost);
+        }
+
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+        // a candidate nested inside another one is rebuilt together with it
+        std::vector<Node*> roots;
+        for(Node* candidate : candidates)
+        {
+            bool nested = false;
+            for(Node* ancestor = candidate->parent; ancestor != NULL && !nested; ancestor = ancestor->parent)
+                nested = std::binary_search(candidates.begin(), candidates.end(), ancestor);
+            if(!nested)
+                roots.push_back(candidate);
+        }
+
+        for(Node* subtree : roots)
+            rebuild(subtree);
+    }
+
+    void rebuild(Node* subtree)
+    {
+        Node* parent = subtree->parent;
+        Node** slot = parent == NULL ? &root : (parent->left == subtree ? &parent->left : &parent->right);
+        int dropped = subtree->invalid;
+
+        std::vector<Node*> live;
+        live.reserve(subtree->size - subtree->invalid);
+        collectHelper(subtree, live);
+        *slot = build(live, 0, live.size(), parent);
+        rebuildCount++;
+
+        for(Node* ancestor = parent; ancestor != NULL; ancestor = ancestor->parent)
+        {
+            ancestor->size -= dropped;
+            ancestor->invalid -= dropped;
+        }
+    }
+
+    // gather the live nodes of a subtree and free the deleted ones
+    static void collectHelper(Node* node, std::vector<Node*>& live)
+    {
+        if(node == NULL)
+            return;
+        collectHelper(node->left, live);
+        collectHelper(node->right, live);
+        if(node->deleted)
+            delete node;
+        else
+            live.push_back(node);
+    }
+
+    // relink nodes[begin, end) into a balanced subtree, splitting on the widest axis at the median
+    static Node* build(std::vector<Node*>& nodeList, size_t begin, size_t end, Node* parent)
+    {
+        if(begin >= end)
+            return NULL;
+
+        float lo[3], hi[3];
+        for(int i = 0; i < 3; i++)
+        {
+            lo[i] = std::numeric_limits<float>::max();
+            hi[i] = -std::numeric_limits<float>::max();
+        }
+        for(size_t n = begin; n < end; n++)
+        {
+            for(int i = 0; i < 3; i++)
+            {
+                float c = pointCoord(nodeList[n]->point, i);
+                lo[i] = std::min(lo[i], c);
+                hi[i] = std::max(hi[i], c);
+            }
+        }
+        int axis = 0;
+        for(int i = 1; i < 3; i++)
+        {
+            if(hi[i] - lo[i] > hi[axis] - lo[axis])
+                axis = i;
+        }
+
+        size_t mid = begin + (end - begin) / 2;
+        std::nth_element(nodeList.begin() + begin, nodeList.begin() + mid, nodeList.begin() + end,
+            [axis](const Node* a, const Node* b) { return pointCoord(a->point, axis) < pointCoord(b->point, axis); });
+
+        Node* node = nodeList[mid];
+        node->axis = axis;
+        node->parent = parent;
+        node->deleted = false;
+        node->size = end - begin;
+        node->invalid = 0;
+        for(int i = 0; i < 3; i++)
+        {
+            node->min[i] = lo[i];
+            node->max[i] = hi[i];
+        }
+        node->left = build(nodeList, begin, mid, node);
+        node->right = build(nodeList, mid + 1, end, node);
+        return node;
+    }
+
+    void searchHelper(const PointT& pivot, const Node* node, float distanceTolSq, std::vector<int>& ids) const
+    {
+        if(node == NULL || node->invalid == node->size || node->boxDistanceSq(pivot) > distanceTolSq)
+            return;
+
+        if(!node->deleted)
+        {
+            float dx = node->point.x - pivot.x;
+            float dy = node->point.y - pivot.y;
+            float dz = node->point.z - pivot.z;
+            if(dx * dx + dy * dy + dz * dz <= distanceTolSq)
+                ids.push_back(node->id);
+        }
+        searchHelper(pivot, node->left, distanceTolSq, ids);
+        searchHelper(pivot, node->right, distanceTolSq, ids);
+    }
+
+    void nearestHelper(const PointT& pivot, const Node* node, int k, std::priority_queue<std::pair<float, int> >& best) const
+    {
+        if(node == NULL || node->invalid == node->size)
+            return;
+        if((int)best.size() == k && node->boxDistanceSq(pivot) >= best.top().first)
+            return;
+
+        if(!node->deleted)
+        {
+            float dx = node->point.x - pivot.x;
+            float dy = node->point.y - pivot.y;
+            float dz = node->point.z - pivot.z;
+            float distSq = dx * dx + dy * dy + dz * dz;
+            if((int)best.size() < k)
+                best.push(std::make_pair(distSq, node->id));
+            else if(distSq < best.top().first)
+            {
+                best.pop();
+                best.push(std::make_pair(distSq, node->id));
+            }
+        }
+
+        // descend into the side of the split holding the pivot first
+        bool goLeft = pointCoord(pivot, node->axis) < pointCoord(node->point, node->axis);
+        nearestHelper(pivot, goLeft ? node->left : node->right, k, best);
+        nearestHelper(pivot, goLeft ? node->right : node->left, k, best);
+    }
+};
+
+// Rolling map over the last windowSize frames: every frame gets a contiguous
+// id range, and the oldest frame is deleted from the tree when a new one comes in.
+template<typename PointT>
+struct SlidingWindowMap
+{
+    IKdTree<PointT> tree;
+    size_t windowSize;
+    int nextId;
+    // first id and point count of every frame currently in the window, oldest first
+    std::deque<std::pair<int, int> > frames;
+
+    SlidingWindowMap(size_t setWindowSize)
+    :   windowSize(setWindowSize), nextId(0)
+    {}
+
+    // add a frame and drop the ones that fell out of the window, returns the first id of the new frame
+    template<typename PointVec>
+    int addFrame(const PointVec& points)
+    {
+        int firstId = nextId;
+        tree.insert(points, firstId);
+        frames.push_back(std::make_pair(firstId, (int)points.size()));
+        nextId += points.size();
+
+        while(frames.size() > windowSize)
+        {
+            tree.remove(frames.front().first, frames.front().second);
+            frames.pop_front();
+        }
+        return firstId;
+    }
+};
+
+#endif /* IKDTREE_H_ */
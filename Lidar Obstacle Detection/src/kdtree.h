@@ -18,6 +18,29 @@ struct KdTree
 	KdTree()
 	: root(NULL)
 	{}
+
+	// frees the nodes without recursion, a tree over sorted input can be as deep as it has points
+	~KdTree()
+	{
+		std::vector<Node*> pending;
+		if(root != NULL)
+			pending.push_back(root);
+		while(!pending.empty())
+		{
+			Node* node = pending.back();
+			pending.pop_back();
+			if(node->left != NULL)
+				pending.push_back(node->left);
+			if(node->right != NULL)
+				pending.push_back(node->right);
+			delete node;
+		}
+	}
+
+	// the tree owns its nodes
+	KdTree(const KdTree&) = delete;
+	KdTree& operator=(const KdTree&) = delete;
+
 	void insertHelper(Node** node, int depth, pcl::PointXYZI point, int id)
     {
       if(*node == NULL) (*node) = new Node(point, id);
@@ -0,0 +1,42 @@
+// Small helper to split a loop over indices across std::threads
+
+#ifndef PARALLEL_H_
+#define PARALLEL_H_
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// number of threads to use when the caller passes 0
+inline int defaultThreadCount()
+{
+    int hw = std::thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+// run func(begin, end) over contiguous chunks of [0, count), one chunk per thread
+template<typename Func>
+void parallelFor(size_t count, int numThreads, Func func)
+{
+    if(numThreads <= 0)
+        numThreads = defaultThreadCount();
+    size_t chunks = std::min<size_t>(numThreads, count);
+    if(chunks <= 1)
+    {
+        if(count > 0)
+            func(size_t(0), count);
+        return;
+    }
+
+    size_t chunkSize = (count + chunks - 1) / chunks;
+    std::vector<std::thread> workers;
+    workers.reserve(chunks - 1);
+    for(size_t begin = chunkSize; begin < count; begin += chunkSize)
+        workers.push_back(std::thread(func, begin, std::min(begin + chunkSize, count)));
+    // the calling thread takes the first chunk
+    func(size_t(0), std::min(chunkSize, count));
+    for(std::thread& worker : workers)
+        worker.join();
+}
+
+#endif /* PARALLEL_H_ */
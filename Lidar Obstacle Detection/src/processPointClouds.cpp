@@ -73,6 +73,86 @@ typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::FilterCloud(ty
 }
 
 
+template<typename PointT>
+typename pcl::PointCloud<PointT>::Ptr ProcessPointClouds<PointT>::MergeClouds(const std::vector<typename pcl::PointCloud<PointT>::Ptr>& clouds, const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> >& transforms, float dedupRes, int numThreads)
+{
+    typename pcl::PointCloud<PointT>::Ptr merged (new pcl::PointCloud<PointT>);
+    if(clouds.size() != transforms.size())
+    {
+        std::cerr << "MergeClouds got " << clouds.size() << " clouds but " << transforms.size() << " transforms" << std::endl;
+        return merged;
+    }
+
+    // Time merging process
+    auto startTime = std::chrono::steady_clock::now();
+
+    // offsets[i] is where the points of cloud i start in the merged cloud
+    std::vector<size_t> offsets(clouds.size() + 1, 0);
+    for(size_t i = 0; i < clouds.size(); i++)
+        offsets[i + 1] = offsets[i] + clouds[i]->points.size();
+
+    merged->points.resize(offsets.back());
+
+    // transform in place into the preallocated output, chunks may span several clouds
+    parallelFor(offsets.back(), numThreads, [&](size_t begin, size_t end)
+    {
+        size_t sensor = std::upper_bound(offsets.begin(), offsets.end(), begin) - offsets.begin() - 1;
+        for(size_t idx = begin; idx < end; idx++)
+        {
+            while(idx >= offsets[sensor + 1])
+                sensor++;
+            const Eigen::Matrix4f& transform = transforms[sensor];
+            const PointT& source = clouds[sensor]->points[idx - offsets[sensor]];
+            PointT& target = merged->points[idx];
+            target = source;
+            target.x = transform(0,0) * source.x + transform(0,1) * source.y + transform(0,2) * source.z + transform(0,3);
+            target.y = transform(1,0) * source.x + transform(1,1) * source.y + transform(1,2) * source.z + transform(1,3);
+            target.z = transform(2,0) * source.x + transform(2,1) * source.y + transform(2,2) * source.z + transform(2,3);
+        }
+    });
+
+    if(dedupRes > 0 && clouds.size() > 1)
+    {
+        // voxel -> first sensor that hit it, later sensors drop their points there
+        std::unordered_map<long long, int> owner;
+        owner.reserve(merged->points.size());
+        size_t kept = 0;
+        size_t sensor = 0;
+        for(size_t idx = 0; idx < merged->points.size(); idx++)
+        {
+            while(idx >= offsets[sensor + 1])
+                sensor++;
+            const PointT& point = merged->points[idx];
+            // non-finite points have no voxel, they are kept as they are
+            if(!std::isfinite(point.x) || !std::isfinite(point.y) || !std::isfinite(point.z))
+            {
+                merged->points[kept++] = point;
+                continue;
+            }
+            long long vx = (long long)floor(point.x / dedupRes) & 0x1FFFFF;
+            long long vy = (long long)floor(point.y / dedupRes) & 0x1FFFFF;
+            long long vz = (long long)floor(point.z / dedupRes) & 0x1FFFFF;
+            long long key = (vx << 42) | (vy << 21) | vz;
+            std::pair<std::unordered_map<long long, int>::iterator, bool> claim = owner.insert(std::make_pair(key, (int)sensor));
+            if(claim.first->second == (int)sensor)
+                merged->points[kept++] = point;
+        }
+        merged->points.resize(kept);
+    }
+    merged->width = merged->points.size();
+    merged->height = 1;
+    merged->is_dense = true;
+    for(size_t i = 0; i < clouds.size(); i++)
+        merged->is_dense = merged->is_dense && clouds[i]->is_dense;
+
+    auto endTime = std::chrono::steady_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+    std::cout << "merging " << clouds.size() << " clouds took " << elapsedTime.count() << " milliseconds, " << merged->points.size() << " of " << offsets.back() << " points kept" << std::endl;
+
+    return merged;
+}
+
+
 template<typename PointT>
 std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::SeparateClouds(pcl::PointIndices::Ptr inliers, typename pcl::PointCloud<PointT>::Ptr cloud) 
 {
@@ -232,6 +312,15 @@ std::vector<boost::filesystem::path> ProcessPointClouds<PointT>::streamPcd(std::
 
 template<typename PointT>
 std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::RANSAC3D(typename pcl::PointCloud<PointT>::Ptr cloud, int maxIterations, float distanceThreshold){
+    return RANSAC3D(cloud, maxIterations, distanceThreshold, std::vector<Eigen::Vector3f>(), 0);
+}
+
+
+template<typename PointT>
+std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::RANSAC3D(typename pcl::PointCloud<PointT>::Ptr cloud, int maxIterations, float distanceThreshold, const std::vector<Eigen::Vector3f>& normals, float maxNormalAngle){
+    // the normal test is skipped when no normals are given
+    bool useNormals = normals.size() == cloud->points.size();
+    float minNormalDot = cos(maxNormalAngle);
     std::unordered_set<int> inliersResult;
 	srand(time(NULL));
 	while(maxIterations--){
@@ -256,6 +345,8 @@ std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT
       float b = (z2 - z1) * (x3 - x1) - (x2 - x1) * (z3 - z1);
       float c = (x2 - x1) * (y3 - y1) - (y2 - y1) * (x3 - x1);
       float d = -(a * x1 + b * y1 + c * z1);
+      float norm = sqrt(a * a + b * b + c * c);
+      Eigen::Vector3f planeNormal(a / norm, b / norm, c / norm);
       
       
       for(int index = 0; index < cloud->points.size(); index++){
@@ -265,8 +356,8 @@ std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT
         float y4 = point.y;
         float z4 = point.z;
         
-        float dist = fabs(a * x4 + b * y4 + c * z4 + d) / sqrt(a * a + b * b + c * c);
-        if (dist <=  distanceThreshold) 
+        float dist = fabs(a * x4 + b * y4 + c * z4 + d) / norm;
+        if (dist <=  distanceThreshold && (!useNormals || fabs(normals[index].dot(planeNormal)) >= minNormalDot))
             inliers.insert(index);
       }
       if(inliers.size() > inliersResult.size()) inliersResult = inliers;
@@ -333,4 +424,126 @@ std::vector<typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::e
         }
     }
     return clusters;
+}
+
+
+template<typename PointT>
+std::vector<Eigen::Vector3f> ProcessPointClouds<PointT>::EstimateNormals(typename pcl::PointCloud<PointT>::Ptr cloud, int k, int numThreads)
+{
+    // Time normal estimation process
+    auto startTime = std::chrono::steady_clock::now();
+
+    IKdTree<PointT> tree;
+    tree.insert(cloud->points, 0);
+    std::vector<int> neighbours;
+    tree.nearest(cloud->points, k, neighbours, numThreads);
+
+    std::vector<Eigen::Vector3f> normals(cloud->points.size(), Eigen::Vector3f(0, 0, 1));
+    parallelFor(cloud->points.size(), numThreads, [&](size_t begin, size_t end)
+    {
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> solver;
+        for(size_t idx = begin; idx < end; idx++)
+        {
+            const int* ids = &neighbours[idx * k];
+            int count = 0;
+            Eigen::Vector3f mean = Eigen::Vector3f::Zero();
+            while(count < k && ids[count] >= 0)
+            {
+                const PointT& point = cloud->points[ids[count]];
+                mean += Eigen::Vector3f(point.x, point.y, point.z);
+                count++;
+            }
+            // not enough neighbours to fit a plane, keep the default up normal
+            if(count < 3)
+                continue;
+            mean /= count;
+
+            Eigen::Matrix3f covariance = Eigen::Matrix3f::Zero();
+            for(int i = 0; i < count; i++)
+            {
+                const PointT& point = cloud->points[ids[i]];
+                Eigen::Vector3f diff = Eigen::Vector3f(point.x, point.y, point.z) - mean;
+                covariance += diff * diff.transpose();
+            }
+
+            // closed-form 3x3 solve, eigenvalues come sorted so column 0 is the plane normal
+            solver.computeDirect(covariance);
+            Eigen::Vector3f normal = solver.eigenvectors().col(0);
+            if(normal.z() < 0)
+                normal = -normal;
+            normals[idx] = normal;
+        }
+    });
+
+    auto endTime = std::chrono::steady_clock::now();
+    auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+    std::cout << "normal estimation took " << elapsedTime.count() << " milliseconds" << std::endl;
+
+    return normals;
+}
+
+template<typename PointT>
+std::vector<typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::euclideanCluster(typename pcl::PointCloud<PointT>::Ptr cloud, const IKdTree<PointT>& tree, float distanceTol, int minSize, int maxSize)
+{
+    std::vector<typename pcl::PointCloud<PointT>::Ptr> clusters;
+    std::vector<bool> processed(cloud->points.size(), false);
+    std::vector<int> cluster_idx;
+    for(size_t idx = 0; idx < cloud->points.size(); ++idx)
+    {
+        if(processed[idx])
+            continue;
+
+        // grow the cluster breadth first instead of recursing, clusters can get large
+        cluster_idx.clear();
+        cluster_idx.push_back(idx);
+        processed[idx] = true;
+        for(size_t next = 0; next < cluster_idx.size(); next++)
+        {
+            std::vector<int> nearest = tree.search(cloud->points[cluster_idx[next]], distanceTol);
+            for(int id : nearest)
+            {
+                if(!processed[id])
+                {
+                    processed[id] = true;
+                    cluster_idx.push_back(id);
+                }
+            }
+        }
+
+        if(cluster_idx.size() >= minSize && cluster_idx.size() <= maxSize)
+        {
+            typename pcl::PointCloud<PointT>::Ptr cloudCluster (new pcl::PointCloud<PointT>);
+            cloudCluster->points.reserve(cluster_idx.size());
+            for(int id : cluster_idx)
+                cloudCluster->points.push_back(cloud->points[id]);
+            cloudCluster->width = cloudCluster->points.size();
+            cloudCluster->height = 1;
+            clusters.push_back(cloudCluster);
+        }
+    }
+    return clusters;
+}
+
+
+template<typename PointT>
+std::vector<typename pcl::PointCloud<PointT>::Ptr> ProcessPointClouds<PointT>::SplitAzimuth(typename pcl::PointCloud<PointT>::Ptr cloud, int numSlices, float startAngle)
+{
+    std::vector<typename pcl::PointCloud<PointT>::Ptr> slices;
+    for(int i = 0; i < numSlices; i++)
+        slices.push_back(typename pcl::PointCloud<PointT>::Ptr(new pcl::PointCloud<PointT>));
+
+    for(const PointT& point : cloud->points)
+    {
+        float angle = atan2(point.y, point.x) - startAngle;
+        angle -= 2 * M_PI * floor(angle / (2 * M_PI));
+        int slice = std::min(numSlices - 1, (int)(angle * numSlices / (2 * M_PI)));
+        slices[slice]->points.push_back(point);
+    }
+
+    for(typename pcl::PointCloud<PointT>::Ptr slice : slices)
+    {
+        slice->width = slice->points.size();
+        slice->height = 1;
+    }
+    return slices;
 }
\ No newline at end of file
@@ -17,8 +17,14 @@
 #include <vector>
 #include <ctime>
 #include <chrono>
+#include <cmath>
 #include "render/box.h"
 #include "kdtree.h"
+#include "ikdtree.h"
+#include "parallel.h"
+#include <Eigen/Eigenvalues>
+#include <Eigen/StdVector>
+#include <unordered_map>
 #include <unordered_set>
 
 template<typename PointT>
@@ -34,6 +40,12 @@ public:
 
     typename pcl::PointCloud<PointT>::Ptr FilterCloud(typename pcl::PointCloud<PointT>::Ptr cloud, float filterRes, Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint);
 
+    // transform the clouds of several lidars by their extrinsics straight into one vehicle frame cloud.
+    // Where sensors overlap, a voxel of size dedupRes keeps the points of the first sensor that hit it (0 disables this).
+    // Non-finite points are passed through, the result is dense only if every input is.
+    // Returns an empty cloud if clouds and transforms differ in size
+    typename pcl::PointCloud<PointT>::Ptr MergeClouds(const std::vector<typename pcl::PointCloud<PointT>::Ptr>& clouds, const std::vector<Eigen::Matrix4f, Eigen::aligned_allocator<Eigen::Matrix4f> >& transforms, float dedupRes, int numThreads = 0);
+
     std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> SeparateClouds(pcl::PointIndices::Ptr inliers, typename pcl::PointCloud<PointT>::Ptr cloud);
 
     std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> SegmentPlane(typename pcl::PointCloud<PointT>::Ptr cloud, int maxIterations, float distanceThreshold);
@@ -48,7 +60,15 @@ public:
 
     std::vector<boost::filesystem::path> streamPcd(std::string dataPath);
     std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> RANSAC3D(typename pcl::PointCloud<PointT>::Ptr cloud, int maxIterations, float distanceThreshold);
+    // RANSAC that also requires an inlier's normal to be within maxNormalAngle (radians) of the plane normal
+    std::pair<typename pcl::PointCloud<PointT>::Ptr, typename pcl::PointCloud<PointT>::Ptr> RANSAC3D(typename pcl::PointCloud<PointT>::Ptr cloud, int maxIterations, float distanceThreshold, const std::vector<Eigen::Vector3f>& normals, float maxNormalAngle);
+    // per-point PCA normals over the k nearest neighbours, oriented towards +z
+    std::vector<Eigen::Vector3f> EstimateNormals(typename pcl::PointCloud<PointT>::Ptr cloud, int k, int numThreads = 0);
   	void clusterHelper(int idx, typename pcl::PointCloud<PointT>::Ptr cloud, std::vector<int>& cluster, std::vector<bool>& processed, KdTree* tree, float distanceTol);
   	std::vector<typename pcl::PointCloud<PointT>::Ptr> euclideanCluster(typename pcl::PointCloud<PointT>::Ptr cloud, KdTree* tree, float distanceTol, int minSize, int maxSize);
+    // same as above but on the 3D incremental tree, tree ids must be the cloud indices
+    std::vector<typename pcl::PointCloud<PointT>::Ptr> euclideanCluster(typename pcl::PointCloud<PointT>::Ptr cloud, const IKdTree<PointT>& tree, float distanceTol, int minSize, int maxSize);
+    // split a full scan into numSlices azimuth wedges, slice i covers startAngle + [i, i+1) * 2pi/numSlices
+    std::vector<typename pcl::PointCloud<PointT>::Ptr> SplitAzimuth(typename pcl::PointCloud<PointT>::Ptr cloud, int numSlices, float startAngle = 0);
 };
 #endif /* PROCESSPOINTCLOUDS_H_ */
@@ -0,0 +1,275 @@
+// Compact point storage for multi-frame history.
+// Positions are kept as integer offsets from a frame origin at a fixed
+// resolution and intensity as one byte, in separate arrays. With int16
+// coordinates a point takes 7 bytes instead of the 32 of a padded
+// pcl::PointXYZI. Crop and voxel filtering work on the integers directly,
+// so old frames only get decoded when they are actually needed.
+
+#ifndef QUANTIZEDCLOUD_H_
+#define QUANTIZEDCLOUD_H_
+
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <Eigen/Core>
+
+// CoordT is int16_t (+-327 m at 1 cm) or int32_t for coarse resolutions / long range
+template<typename CoordT = int16_t>
+struct QuantizedCloud
+{
+    Eigen::Vector3f origin;
+    float resolution;
+    // intensity is stored as round(intensity * 255 / maxIntensity)
+    float maxIntensity;
+
+    std::vector<CoordT> x;
+    std::vector<CoordT> y;
+    std::vector<CoordT> z;
+    std::vector<uint8_t> intensity;
+
+    // points that did not fit the coordinate range at encode time
+    size_t dropped;
+
+    QuantizedCloud(Eigen::Vector3f setOrigin = Eigen::Vector3f::Zero(), float setResolution = 0.01f, float setMaxIntensity = 1.0f)
+    :   origin(setOrigin), resolution(setResolution), maxIntensity(setMaxIntensity), dropped(0)
+    {}
+
+    size_t size() const
+    {
+        return x.size();
+    }
+
+    size_t memoryBytes() const
+    {
+        return (x.capacity() + y.capacity() + z.capacity()) * sizeof(CoordT) + intensity.capacity();
+    }
+
+    void reserve(size_t n)
+    {
+        x.reserve(n);
+        y.reserve(n);
+        z.reserve(n);
+        intensity.reserve(n);
+    }
+
+    void clear()
+    {
+        x.clear();
+        y.clear();
+        z.clear();
+        intensity.clear();
+        dropped = 0;
+    }
+
+    // append points (anything with x, y, z and intensity), points out of range are counted in dropped
+    template<typename PointVec>
+    void encode(const PointVec& points)
+    {
+        reserve(size() + points.size());
+        float scale = 1.0f / resolution;
+        float intensityScale = 255.0f / maxIntensity;
+        for(size_t i = 0; i < points.size(); i++)
+        {
+            float qx = std::round((points[i].x - origin[0]) * scale);
+            float qy = std::round((points[i].y - origin[1]) * scale);
+            float qz = std::round((points[i].z - origin[2]) * scale);
+            if(!inRange(qx) || !inRange(qy) || !inRange(qz))
+            {
+                dropped++;
+                continue;
+            }
+            x.push_back((CoordT)qx);
+            y.push_back((CoordT)qy);
+            z.push_back((CoordT)qz);
+            float qi = std::round(points[i].intensity * intensityScale);
+            intensity.push_back((uint8_t)std::min(255.0f, std::max(0.0f, qi)));
+        }
+    }
+
+    // decode points [begin, begin + count) into float SoA blocks. The loops are plain
+    // int -> float converts and multiply-adds over contiguous arrays, so the compiler
+    // vectorises them
+    void decode(size_t begin, size_t count, float* __restrict outX, float* __restrict outY, float* __restrict outZ, float* __restrict outIntensity) const
+    {
+        const CoordT* __restrict qx = x.data() + begin;
+        const CoordT* __restrict qy = y.data() + begin;
+        const CoordT* __restrict qz = z.data() + begin;
+        const uint8_t* __restrict qi = intensity.data() + begin;
+        const float ox = origin[0];
+        const float oy = origin[1];
+        const float oz = origin[2];
+        const float res = resolution;
+        const float intensityStep = maxIntensity / 255.0f;
+        for(size_t i = 0; i < count; i++)
+            outX[i] = ox + res * qx[i];
+        for(size_t i = 0; i < count; i++)
+            outY[i] = oy + res * qy[i];
+        for(size_t i = 0; i < count; i++)
+            outZ[i] = oz + res * qz[i];
+        if(outIntensity != NULL)
+        {
+            for(size_t i = 0; i < count; i++)
+                outIntensity[i] = intensityStep * qi[i];
+        }
+    }
+
+    // decode everything back into an AoS point vector, e.g. cloud->points
+    template<typename PointVec>
+    void decodeTo(PointVec& points) const
+    {
+        const size_t block = 256;
+        float bx[block], by[block], bz[block], bi[block];
+        points.resize(size());
+        for(size_t begin = 0; begin < size(); begin += block)
+        {
+            size_t count = std::min(block, size() - begin);
+            decode(begin, count, bx, by, bz, bi);
+            for(size_t i = 0; i < count; i++)
+            {
+                points[begin + i].x = bx[i];
+                points[begin + i].y = by[i];
+                points[begin + i].z = bz[i];
+                points[begin + i].intensity = bi[i];
+            }
+        }
+    }
+
+    // points inside [minPoint, maxPoint], compared in the integer domain
+    QuantizedCloud cropBox(Eigen::Vector4f minPoint, Eigen::Vector4f maxPoint) const
+    {
+        int64_t lo[3], hi[3];
+        for(int i = 0; i < 3; i++)
+        {
+            lo[i] = (int64_t)std::ceil((minPoint[i] - origin[i]) / resolution);
+            hi[i] = (int64_t)std::floor((maxPoint[i] - origin[i]) / resolution);
+        }
+
+        QuantizedCloud result(origin, resolution, maxIntensity);
+        for(size_t i = 0; i < size(); i++)
+        {
+            if(x[i] >= lo[0] && x[i] <= hi[0] && y[i] >= lo[1] && y[i] <= hi[1] && z[i] >= lo[2] && z[i] <= hi[2])
+                result.push(x[i], y[i], z[i], intensity[i]);
+        }
+        return result;
+    }
+
+    // voxel grid reduction like pcl::VoxelGrid, every occupied voxel is replaced by the centroid of its points
+    QuantizedCloud voxelFilter(float leafSize) const
+    {
+        int64_t leaf = std::max<int64_t>(1, (int64_t)std::round(leafSize / resolution));
+
+        struct Accumulator
+        {
+            int64_t x, y, z, intensity;
+            int64_t count;
+        };
+        std::unordered_map<uint64_t, size_t> voxels;
+        std::vector<Accumulator> sums;
+        voxels.reserve(size());
+        for(size_t i = 0; i < size(); i++)
+        {
+            uint64_t key = voxelKey(floorDiv(x[i], leaf), floorDiv(y[i], leaf), floorDiv(z[i], leaf));
+            std::pair<std::unordered_map<uint64_t, size_t>::iterator, bool> slot = voxels.insert(std::make_pair(key, sums.size()));
+            if(slot.second)
+            {
+                Accumulator empty = {0, 0, 0, 0, 0};
+                sums.push_back(empty);
+            }
+            Accumulator& sum = sums[slot.first->second];
+            sum.x += x[i];
+            sum.y += y[i];
+            sum.z += z[i];
+            sum.intensity += intensity[i];
+            sum.count++;
+        }
+
+        QuantizedCloud result(origin, resolution, maxIntensity);
+        result.reserve(sums.size());
+        for(const Accumulator& sum : sums)
+        {
+            result.push((CoordT)roundDiv(sum.x, sum.count), (CoordT)roundDiv(sum.y, sum.count), (CoordT)roundDiv(sum.z, sum.count),
+                        (uint8_t)roundDiv(sum.intensity, sum.count));
+        }
+        return result;
+    }
+
+private:
+    static bool inRange(float q)
+    {
+        return q >= std::numeric_limits<CoordT>::min() && q <= std::numeric_limits<CoordT>::max();
+    }
+
+    void push(CoordT qx, CoordT qy, CoordT qz, uint8_t qi)
+    {
+        x.push_back(qx);
+        y.push_back(qy);
+        z.push_back(qz);
+        intensity.push_back(qi);
+    }
+
+    static int64_t floorDiv(int64_t a, int64_t b)
+    {
+        int64_t q = a / b;
+        return (a % b != 0 && a < 0) ? q - 1 : q;
+    }
+
+    static int64_t roundDiv(int64_t a, int64_t b)
+    {
+        return a >= 0 ? (a + b / 2) / b : -((-a + b / 2) / b);
+    }
+
+    static uint64_t voxelKey(int64_t vx, int64_t vy, int64_t vz)
+    {
+        return ((uint64_t)(vx & 0x1FFFFF) << 42) | ((uint64_t)(vy & 0x1FFFFF) << 21) | (uint64_t)(vz & 0x1FFFFF);
+    }
+};
+
+// ring of the last maxFrames quantized frames, the oldest is dropped when a new one comes in
+template<typename CoordT = int16_t>
+struct QuantizedHistory
+{
+    std::deque<QuantizedCloud<CoordT> > frames;
+    size_t maxFrames;
+    float resolution;
+    float maxIntensity;
+
+    QuantizedHistory(size_t setMaxFrames, float setResolution = 0.01f, float setMaxIntensity = 1.0f)
+    :   maxFrames(setMaxFrames), resolution(setResolution), maxIntensity(setMaxIntensity)
+    {}
+
+    // store a frame relative to origin, usually the ego position when it was taken.
+    // Returns the stored frame, or NULL if maxFrames is 0 and nothing is kept
+    template<typename PointVec>
+    QuantizedCloud<CoordT>* push(const PointVec& points, Eigen::Vector3f origin)
+    {
+        while(!frames.empty() && frames.size() >= maxFrames)
+            frames.pop_front();
+        if(maxFrames == 0)
+            return NULL;
+        frames.push_back(QuantizedCloud<CoordT>(origin, resolution, maxIntensity));
+        frames.back().encode(points);
+        return &frames.back();
+    }
+
+    size_t size() const
+    {
+        size_t points = 0;
+        for(const QuantizedCloud<CoordT>& frame : frames)
+            points += frame.size();
+        return points;
+    }
+
+    size_t memoryBytes() const
+    {
+        size_t bytes = 0;
+        for(const QuantizedCloud<CoordT>& frame : frames)
+            bytes += frame.memoryBytes();
+        return bytes;
+    }
+};
+
+#endif /* QUANTIZEDCLOUD_H_ */
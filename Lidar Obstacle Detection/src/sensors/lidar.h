@@ -3,6 +3,7 @@
 #include "../render/render.h"
 #include <ctime>
 #include <chrono>
+#include "rng.h"
 
 const double pi = 3.1415;
 
@@ -10,6 +11,7 @@ struct Ray
 {
 	
 	Vect3 origin;
+	double angle;
 	double resolution;
 	Vect3 direction;
 	Vect3 castPosition;
@@ -23,11 +25,14 @@ struct Ray
 	// resoultion: the magnitude of the ray's step, used for ray casting, the smaller the more accurate but the more expensive
 
 	Ray(Vect3 setOrigin, double horizontalAngle, double verticalAngle, double setResolution)
-		: origin(setOrigin), resolution(setResolution), direction(resolution*cos(verticalAngle)*cos(horizontalAngle), resolution*cos(verticalAngle)*sin(horizontalAngle),resolution*sin(verticalAngle)),
+		: origin(setOrigin), angle(horizontalAngle), resolution(setResolution), direction(resolution*cos(verticalAngle)*cos(horizontalAngle), resolution*cos(verticalAngle)*sin(horizontalAngle),resolution*sin(verticalAngle)),
 		  castPosition(origin), castDistance(0)
 	{}
 
-	void rayCast(const std::vector<Car>& cars, double minDistance, double maxDistance, pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud, double slopeAngle, double sderr)
+	// noiseSeed, scanIndex and rayIndex key the point noise, so a scan is reproducible.
+	// Points are reported relative to frameOrigin
+	void rayCast(const std::vector<Car>& cars, double minDistance, double maxDistance, pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud, double slopeAngle, double sderr,
+				 const Vect3& frameOrigin, uint64_t noiseSeed, uint64_t scanIndex, uint64_t rayIndex)
 	{
 		// reset ray
 		castPosition = origin;
@@ -59,10 +64,11 @@ struct Ray
 		if((castDistance >= minDistance)&&(castDistance<=maxDistance))
 		{
 			// add noise based on standard deviation error
-			double rx = ((double) rand() / (RAND_MAX));
-			double ry = ((double) rand() / (RAND_MAX));
-			double rz = ((double) rand() / (RAND_MAX));
-			cloud->points.push_back(pcl::PointXYZ(castPosition.x+rx*sderr, castPosition.y+ry*sderr, castPosition.z+rz*sderr));
+			Philox4x32 noise(noiseSeed, scanIndex, rayIndex);
+			double rx = noise.uniform(0);
+			double ry = noise.uniform(1);
+			double rz = noise.uniform(2);
+			cloud->points.push_back(pcl::PointXYZ(castPosition.x-frameOrigin.x+rx*sderr, castPosition.y-frameOrigin.y+ry*sderr, castPosition.z-frameOrigin.z+rz*sderr));
 		}
 			
 	}
@@ -76,14 +82,21 @@ struct Lidar
 	pcl::PointCloud<pcl::PointXYZ>::Ptr cloud;
 	std::vector<Car> cars;
 	Vect3 position;
+	// origin of the frame the points are reported in, the vehicle origin by default
+	Vect3 frameOrigin;
 	double groundSlope;
 	double minDistance;
 	double maxDistance;
 	double resoultion;
 	double sderr;
-
-	Lidar(std::vector<Car> setCars, double setGroundSlope)
-		: cloud(new pcl::PointCloud<pcl::PointXYZ>()), position(0,0,2.6)
+	// key of the point noise, scanCount moves on with every scan()
+	uint64_t noiseSeed;
+	uint64_t scanCount;
+
+	// a lidar mounted elsewhere than the roof can report its points in its own frame
+	// by passing its mounting point as setFrameOrigin, see extrinsic()
+	Lidar(std::vector<Car> setCars, double setGroundSlope, Vect3 setPosition = Vect3(0,0,2.6), Vect3 setFrameOrigin = Vect3(0,0,0))
+		: cloud(new pcl::PointCloud<pcl::PointXYZ>()), position(setPosition), frameOrigin(setFrameOrigin)
 	{
 		// TODO:: set minDistance to 5 to remove points from roof of ego car
 		minDistance = 5;
@@ -93,6 +106,8 @@ struct Lidar
 		sderr = 0.2;
 		cars = setCars;
 		groundSlope = setGroundSlope;
+		noiseSeed = 0;
+		scanCount = 0;
 
 		// TODO:: increase number of layers to 8 to get higher resoultion pcd
 		int numLayers = 8;
@@ -114,6 +129,16 @@ struct Lidar
 		}
 	}
 
+	// transform of the reported points into the vehicle frame
+	Eigen::Matrix4f extrinsic() const
+	{
+		Eigen::Matrix4f transform = Eigen::Matrix4f::Identity();
+		transform(0,3) = frameOrigin.x;
+		transform(1,3) = frameOrigin.y;
+		transform(2,3) = frameOrigin.z;
+		return transform;
+	}
+
 	~Lidar()
 	{
 		// pcl uses boost smart pointers for cloud pointer so we don't have to worry about manually freeing the memory
@@ -123,8 +148,12 @@ struct Lidar
 	{
 		cloud->points.clear();
 		auto startTime = std::chrono::steady_clock::now();
-		for(Ray ray : rays)
-			ray.rayCast(cars, minDistance, maxDistance, cloud, groundSlope, sderr);
+		for(size_t i = 0; i < rays.size(); i++)
+		{
+			Ray ray = rays[i];
+			ray.rayCast(cars, minDistance, maxDistance, cloud, groundSlope, sderr, frameOrigin, noiseSeed, scanCount, i);
+		}
+		scanCount++;
 		auto endTime = std::chrono::steady_clock::now();
 		auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
 		cout << "ray casting took " << elapsedTime.count() << " milliseconds" << endl;
@@ -133,6 +162,25 @@ struct Lidar
 		return cloud;
 	}
 
+	// cast only the rays with horizontal angle in [minAngle, maxAngle), so a scan
+	// can be handed downstream one azimuth wedge at a time. The wedge may wrap around 0.
+	// All wedges of a scan share its scanCount, advance it once the scan is complete
+	pcl::PointCloud<pcl::PointXYZ>::Ptr scanWedge(double minAngle, double maxAngle)
+	{
+		pcl::PointCloud<pcl::PointXYZ>::Ptr wedge(new pcl::PointCloud<pcl::PointXYZ>());
+		for(size_t i = 0; i < rays.size(); i++)
+		{
+			Ray ray = rays[i];
+			double offset = ray.angle - minAngle;
+			offset -= 2*M_PI*floor(offset/(2*M_PI));
+			if(offset < maxAngle - minAngle)
+				ray.rayCast(cars, minDistance, maxDistance, wedge, groundSlope, sderr, frameOrigin, noiseSeed, scanCount, i);
+		}
+		wedge->width = wedge->points.size();
+		wedge->height = 1;
+		return wedge;
+	}
+
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,130 @@
+#ifndef ACCUMULATORS_H_
+#define ACCUMULATORS_H_
+// Running accuracy and consistency metrics, updated in O(1) per sample so a
+// run does not need to keep every estimate around. With a window size the
+// metrics cover only the latest window samples.
+
+#include <cstddef>
+#include <vector>
+#include "Eigen/Dense"
+
+// RMSE of estimates against ground truth
+class RMSEAccumulator
+{
+public:
+	// size: components per sample, window: samples covered, 0 for the whole run
+	RMSEAccumulator(int size = 4, size_t window = 0)
+		: sum(Eigen::VectorXd::Zero(size)), squared(size), history(size, window), window(window), samples(0)
+	{}
+
+	void add(const Eigen::VectorXd& estimate, const Eigen::VectorXd& truth)
+	{
+		squared = (estimate - truth).cwiseAbs2();
+		if(window > 0)
+		{
+			// ring buffer of the squared residuals, the oldest one drops out of the sum
+			size_t slot = samples % window;
+			if(samples >= window)
+				sum -= history.col(slot);
+			history.col(slot) = squared;
+		}
+		sum += squared;
+		samples++;
+	}
+
+	Eigen::VectorXd rmse() const
+	{
+		if(count() == 0)
+			return Eigen::VectorXd::Zero(sum.size());
+		return (sum / count()).cwiseMax(0.0).cwiseSqrt();
+	}
+
+	size_t count() const
+	{
+		return window > 0 && samples > window ? window : samples;
+	}
+
+	void reset()
+	{
+		sum.setZero();
+		samples = 0;
+	}
+
+private:
+	Eigen::VectorXd sum;
+	Eigen::VectorXd squared;
+	Eigen::MatrixXd history;
+	size_t window;
+	size_t samples;
+};
+
+// NIS mean and the share of samples above the 95% chi-square bound
+class NISAccumulator
+{
+public:
+	// dof: measurement dimension (2 for lidar, 3 for radar), window: samples covered, 0 for the whole run
+	NISAccumulator(int dof, size_t window = 0)
+		: bound(chiSquare95(dof)), sum(0), above(0), history(window, 0.0), window(window), samples(0)
+	{}
+
+	void add(double nis)
+	{
+		if(window > 0)
+		{
+			size_t slot = samples % window;
+			if(samples >= window)
+			{
+				sum -= history[slot];
+				above -= history[slot] > bound;
+			}
+			history[slot] = nis;
+		}
+		sum += nis;
+		above += nis > bound;
+		samples++;
+	}
+
+	double mean() const
+	{
+		return count() > 0 ? sum / count() : 0;
+	}
+
+	// percentage of samples above the bound, about 5 for a consistent filter
+	double percentAbove() const
+	{
+		return count() > 0 ? 100.0 * above / count() : 0;
+	}
+
+	size_t count() const
+	{
+		return window > 0 && samples > window ? window : samples;
+	}
+
+	double chiSquareBound() const
+	{
+		return bound;
+	}
+
+	void reset()
+	{
+		sum = 0;
+		above = 0;
+		samples = 0;
+	}
+
+	static double chiSquare95(int dof)
+	{
+		static const double table[] = {3.841, 5.991, 7.815, 9.488, 11.070};
+		return dof >= 1 && dof <= 5 ? table[dof - 1] : 0;
+	}
+
+private:
+	double bound;
+	double sum;
+	size_t above;
+	std::vector<double> history;
+	size_t window;
+	size_t samples;
+};
+
+#endif /* ACCUMULATORS_H_ */
@@ -0,0 +1,448 @@
+#ifndef ASSOCIATION_H_
+#define ASSOCIATION_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "Eigen/Dense"
+#include "measurement_package.h"
+#include "ukf_fixed.h"
+
+/**
+ * Multi-target tracker for unlabeled lidar and radar detections. Every
+ * association round runs in three stages:
+ *  - coarse gating: detections are bucketed in a uniform grid and each track
+ *    only looks at the cells its gate can reach
+ *  - fine gating: the squared Mahalanobis distance of the detection under
+ *    the track's predicted measurement and innovation covariance must be
+ *    below the sensor's gate
+ *  - assignment: tracks and detections linked by gated pairs form connected
+ *    components, each solved on its own with the Hungarian method, where
+ *    leaving a track or a detection unassigned costs the gate
+ * Assigned tracks get a CTRVFixedUKF update with the native measurement,
+ * detections outside every gate start tentative tracks and tracks that keep
+ * missing are dropped.
+ */
+class MultiTargetTracker {
+ public:
+  struct Track {
+    // unique over the life of the tracker
+    int id;
+
+    // associated detections and association rounds missed in a row
+    int hits;
+    int misses;
+
+    // set once the track has had confirm_hits_ detections
+    bool confirmed;
+
+    CTRVFixedUKF filter;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  MultiTargetTracker()
+      : lidar_gate_(18.42), radar_gate_(21.11), cell_size_(4.0), confirm_hits_(3), max_misses_(6),
+        next_id_(0), gate_(0) {}
+
+  /**
+   * Associates one frame of detections with the tracks and updates them.
+   * Detections must share one timestamp, lidar and radar detections are
+   * associated in separate rounds since a track can take one of each.
+   */
+  void ProcessDetections(const std::vector<MeasurementPackage>& detections) {
+    round_.clear();
+    for (size_t i = 0; i < detections.size(); ++i) {
+      if (detections[i].sensor_type_ == MeasurementPackage::LASER)
+        round_.push_back(detections[i]);
+    }
+    if (!round_.empty())
+      Associate(lidar_, lidar_gate_, round_);
+
+    round_.clear();
+    for (size_t i = 0; i < detections.size(); ++i) {
+      if (detections[i].sensor_type_ == MeasurementPackage::RADAR)
+        round_.push_back(detections[i]);
+    }
+    if (!round_.empty())
+      Associate(radar_, radar_gate_, round_);
+  }
+
+  const std::vector<Track, Eigen::aligned_allocator<Track> >& Tracks() const {
+    return tracks_;
+  }
+
+  /**
+   * Confirmed track closest to a position
+   * @return Index into Tracks(), or -1 if no confirmed track is within
+   *     max_distance
+   */
+  int Nearest(double px, double py, double max_distance) const {
+    int nearest = -1;
+    double best = max_distance * max_distance;
+    for (size_t i = 0; i < tracks_.size(); ++i) {
+      if (!tracks_[i].confirmed)
+        continue;
+      double dx = tracks_[i].filter.x_(0) - px, dy = tracks_[i].filter.x_(1) - py;
+      if (dx*dx + dy*dy <= best) {
+        best = dx*dx + dy*dy;
+        nearest = i;
+      }
+    }
+    return nearest;
+  }
+
+  // squared Mahalanobis gates, 99.99% chi-square bounds for 2 and 3 dof. A
+  // tighter gate drops tracks of manoeuvring cars the CTRV model lags behind
+  double lidar_gate_;
+  double radar_gate_;
+
+  // grid cell size in m, about the size of a typical gate
+  double cell_size_;
+
+  // detections before a track is confirmed
+  int confirm_hits_;
+
+  // association rounds a confirmed track may miss, a tentative track is
+  // dropped on its first miss
+  int max_misses_;
+
+  // noise models shared with the track filters
+  LidarModel lidar_;
+  RadarModel radar_;
+
+ private:
+  struct Candidate {
+    int track;
+    int detection;
+    double cost;
+    int component;
+  };
+
+  static int64_t CellKey(int64_t cx, int64_t cy) {
+    return (cx << 32) ^ (cy & 0xffffffff);
+  }
+
+  int64_t CellCoord(double position) const {
+    return (int64_t)std::floor(position / cell_size_);
+  }
+
+  // largest eigenvalue of a symmetric 2x2 matrix
+  static double MaxEigenvalue(const Eigen::Matrix2d& M) {
+    double mean = .5 * (M(0, 0) + M(1, 1));
+    double diff = .5 * (M(0, 0) - M(1, 1));
+    return mean + std::sqrt(diff*diff + M(0, 1)*M(1, 0));
+  }
+
+  // position and position covariance of a detection in Cartesian coordinates
+  void DetectionPosition(const MeasurementPackage& detection, Eigen::Vector2d& position, Eigen::Matrix2d& R) const {
+    const Eigen::VectorXd& z = detection.raw_measurements_;
+    if (detection.sensor_type_ == MeasurementPackage::RADAR) {
+      double c = cos(z(1)), s = sin(z(1));
+      position << z(0) * c, z(0) * s;
+      Eigen::Matrix2d J;
+      J << c, -z(0) * s,
+           s, z(0) * c;
+      Eigen::Matrix2d polar = Eigen::Matrix2d::Zero();
+      polar(0, 0) = radar_.std_radr_ * radar_.std_radr_;
+      polar(1, 1) = radar_.std_radphi_ * radar_.std_radphi_;
+      R = J * polar * J.transpose();
+    } else {
+      position = z.head(2);
+      R = lidar_.NoiseCovariance();
+    }
+  }
+
+  int Find(int node) {
+    while (parent_[node] != node) {
+      parent_[node] = parent_[parent_[node]];
+      node = parent_[node];
+    }
+    return node;
+  }
+
+  /**
+   * One association round over detections of the sensor described by model
+   * @param gate Squared Mahalanobis gate, also the cost of leaving a track or
+   *     a detection unassigned
+   */
+  template <typename MeasModel>
+  void Associate(const MeasModel& model, double gate, const std::vector<MeasurementPackage>& detections) {
+    enum { NZ = MeasModel::kSize };
+    typedef Eigen::Matrix<double, NZ, 1> MeasVector;
+    typedef Eigen::Matrix<double, NZ, NZ> MeasMatrix;
+    int num_tracks = tracks_.size();
+    int num_detections = detections.size();
+    long long timestamp = detections[0].timestamp_;
+    gate_ = gate;
+
+    // predict every track to the frame time. A second round at the same time
+    // predicts by 0, which refreshes the sigma points after the last update
+    for (int t = 0; t < num_tracks; ++t) {
+      CTRVFixedUKF& filter = tracks_[t].filter;
+      filter.Prediction(std::max(0LL, timestamp - filter.time_us_) / 1000000.0);
+      filter.time_us_ = std::max(timestamp, filter.time_us_);
+    }
+
+    // predicted measurement and inverse innovation covariance of every track
+    track_z_.resize(num_tracks * NZ);
+    track_S_inv_.resize(num_tracks * NZ * NZ);
+    for (int t = 0; t < num_tracks; ++t) {
+      MeasVector z_pred;
+      MeasMatrix S;
+      tracks_[t].filter.PredictMeasurement(model, z_pred, S);
+      Eigen::Map<MeasVector> track_z(&track_z_[t * NZ]);
+      Eigen::Map<MeasMatrix> track_S_inv(&track_S_inv_[t * NZ * NZ]);
+      track_z = z_pred;
+      track_S_inv = S.inverse();
+    }
+    auto gate_pair = [&](int t, int d) {
+      MeasVector z_diff = Eigen::Map<const MeasVector>(detections[d].raw_measurements_.data())
+                          - Eigen::Map<const MeasVector>(&track_z_[t * NZ]);
+      if (MeasModel::kAngleIndex >= 0)
+        z_diff(MeasModel::kAngleIndex) = NormalizeAngle(z_diff(MeasModel::kAngleIndex));
+      double distance = z_diff.dot(Eigen::Map<const MeasMatrix>(&track_S_inv_[t * NZ * NZ]) * z_diff);
+      if (distance <= gate) {
+        Candidate candidate = {t, d, distance, 0};
+        candidates_.push_back(candidate);
+      }
+    };
+
+    // detection positions in a grid, sorted by cell. The grid works on
+    // Cartesian positions whatever the sensor measures
+    positions_.resize(num_detections);
+    noise_.resize(num_detections);
+    cells_.clear();
+    double max_noise = 0;
+    for (int d = 0; d < num_detections; ++d) {
+      DetectionPosition(detections[d], positions_[d], noise_[d]);
+      max_noise = std::max(max_noise, MaxEigenvalue(noise_[d]));
+      cells_.push_back(std::make_pair(CellKey(CellCoord(positions_[d](0)), CellCoord(positions_[d](1))), d));
+    }
+    std::sort(cells_.begin(), cells_.end());
+
+    // coarse gating through the grid, then Mahalanobis gating in measurement space
+    candidates_.clear();
+    for (int t = 0; t < num_tracks; ++t) {
+      const CTRVFixedUKF& filter = tracks_[t].filter;
+      Eigen::Vector2d mean = filter.x_.head<2>();
+      Eigen::Matrix2d covariance = filter.P_.topLeftCorner<2, 2>();
+      // a detection outside this radius is beyond the gate in position alone
+      double radius = std::sqrt(gate * (MaxEigenvalue(covariance) + max_noise));
+      int64_t x_min = CellCoord(mean(0) - radius), x_max = CellCoord(mean(0) + radius);
+      int64_t y_min = CellCoord(mean(1) - radius), y_max = CellCoord(mean(1) + radius);
+      if ((x_max - x_min + 1) * (y_max - y_min + 1) > num_detections) {
+        // a gate this wide is cheaper to test against every detection
+        for (int d = 0; d < num_detections; ++d)
+          gate_pair(t, d);
+        continue;
+      }
+      for (int64_t cx = x_min; cx <= x_max; ++cx) {
+        for (int64_t cy = y_min; cy <= y_max; ++cy) {
+          std::vector<std::pair<int64_t, int> >::const_iterator it = std::lower_bound(
+              cells_.begin(), cells_.end(), std::make_pair(CellKey(cx, cy), -1));
+          for (; it != cells_.end() && it->first == CellKey(cx, cy); ++it)
+            gate_pair(t, it->second);
+        }
+      }
+    }
+
+    // connected components of the gated pairs, tracks are nodes
+    // 0..num_tracks-1 and detections follow
+    parent_.resize(num_tracks + num_detections);
+    for (size_t i = 0; i < parent_.size(); ++i)
+      parent_[i] = i;
+    for (size_t i = 0; i < candidates_.size(); ++i) {
+      int a = Find(candidates_[i].track), b = Find(num_tracks + candidates_[i].detection);
+      if (a != b)
+        parent_[a] = b;
+    }
+    for (size_t i = 0; i < candidates_.size(); ++i)
+      candidates_[i].component = Find(candidates_[i].track);
+    std::sort(candidates_.begin(), candidates_.end(), [](const Candidate& a, const Candidate& b) {
+      return a.component < b.component;
+    });
+
+    assigned_track_.assign(num_tracks, -1);
+    // -1 for detections outside every gate, -2 for gated but unassigned ones
+    assigned_detection_.assign(num_detections, -1);
+    for (size_t i = 0; i < candidates_.size(); ++i)
+      assigned_detection_[candidates_[i].detection] = -2;
+    for (size_t begin = 0; begin < candidates_.size();) {
+      size_t end = begin + 1;
+      while (end < candidates_.size() && candidates_[end].component == candidates_[begin].component)
+        ++end;
+      SolveComponent(begin, end);
+      begin = end;
+    }
+
+    // update, age and drop tracks
+    for (int t = 0; t < num_tracks; ++t) {
+      Track& track = tracks_[t];
+      int d = assigned_track_[t];
+      if (d < 0) {
+        track.misses++;
+        continue;
+      }
+      double nis = track.filter.Update(model, Eigen::Map<const MeasVector>(detections[d].raw_measurements_.data()));
+      (detections[d].sensor_type_ == MeasurementPackage::RADAR ? track.filter.NIS_radar_ : track.filter.NIS_laser_) = nis;
+      track.hits++;
+      track.misses = 0;
+      if (track.hits >= confirm_hits_)
+        track.confirmed = true;
+    }
+    size_t kept = 0;
+    for (size_t t = 0; t < tracks_.size(); ++t) {
+      if (tracks_[t].misses > (tracks_[t].confirmed ? max_misses_ : 0))
+        continue;
+      if (kept != t)
+        tracks_[kept] = tracks_[t];
+      kept++;
+    }
+    tracks_.resize(kept);
+
+    // a detection outside every gate starts a tentative track. One that lost
+    // the assignment is most likely a noisy duplicate, not a new object
+    for (int d = 0; d < num_detections; ++d) {
+      if (assigned_detection_[d] != -1)
+        continue;
+      Track track;
+      track.id = next_id_++;
+      track.hits = 1;
+      track.misses = 0;
+      track.confirmed = confirm_hits_ <= 1;
+      track.filter.lidar_ = lidar_;
+      track.filter.radar_ = radar_;
+      track.filter.ProcessMeasurement(detections[d]);
+      tracks_.push_back(track);
+    }
+  }
+
+  /**
+   * Hungarian method on one component, candidates_[begin, end). The square
+   * cost matrix has the real pairs top left and a dummy column per track and
+   * a dummy row per detection, so any of them may stay unassigned at the
+   * gate of the round.
+   */
+  void SolveComponent(size_t begin, size_t end) {
+    // local indices of the tracks and detections in this component
+    local_tracks_.clear();
+    local_detections_.clear();
+    for (size_t i = begin; i < end; ++i) {
+      local_tracks_.push_back(candidates_[i].track);
+      local_detections_.push_back(candidates_[i].detection);
+    }
+    std::sort(local_tracks_.begin(), local_tracks_.end());
+    local_tracks_.erase(std::unique(local_tracks_.begin(), local_tracks_.end()), local_tracks_.end());
+    std::sort(local_detections_.begin(), local_detections_.end());
+    local_detections_.erase(std::unique(local_detections_.begin(), local_detections_.end()), local_detections_.end());
+    int nt = local_tracks_.size(), nd = local_detections_.size();
+
+    // a single pair needs no assignment
+    if (nt == 1 && nd == 1) {
+      assigned_track_[local_tracks_[0]] = local_detections_[0];
+      assigned_detection_[local_detections_[0]] = local_tracks_[0];
+      return;
+    }
+
+    const double forbidden = 1e9;
+    int n = nt + nd;
+    cost_.assign(n * n, forbidden);
+    for (int i = 0; i < nt; ++i)
+      cost_[i * n + nd + i] = gate_;
+    for (int j = 0; j < nd; ++j)
+      cost_[(nt + j) * n + j] = gate_;
+    for (int i = nt; i < n; ++i) {
+      for (int j = nd; j < n; ++j)
+        cost_[i * n + j] = 0;
+    }
+    for (size_t k = begin; k < end; ++k) {
+      int i = std::lower_bound(local_tracks_.begin(), local_tracks_.end(), candidates_[k].track) - local_tracks_.begin();
+      int j = std::lower_bound(local_detections_.begin(), local_detections_.end(), candidates_[k].detection)
+              - local_detections_.begin();
+      cost_[i * n + j] = candidates_[k].cost;
+    }
+
+    // shortest augmenting paths with row and column potentials, 1 based
+    const double infinity = std::numeric_limits<double>::infinity();
+    u_.assign(n + 1, 0);
+    v_.assign(n + 1, 0);
+    match_.assign(n + 1, 0);
+    way_.assign(n + 1, 0);
+    for (int i = 1; i <= n; ++i) {
+      match_[0] = i;
+      int j0 = 0;
+      min_slack_.assign(n + 1, infinity);
+      used_.assign(n + 1, 0);
+      do {
+        used_[j0] = 1;
+        int i0 = match_[j0], j1 = 0;
+        double delta = infinity;
+        for (int j = 1; j <= n; ++j) {
+          if (used_[j])
+            continue;
+          double slack = cost_[(i0 - 1) * n + j - 1] - u_[i0] - v_[j];
+          if (slack < min_slack_[j]) {
+            min_slack_[j] = slack;
+            way_[j] = j0;
+          }
+          if (min_slack_[j] < delta) {
+            delta = min_slack_[j];
+            j1 = j;
+          }
+        }
+        for (int j = 0; j <= n; ++j) {
+          if (used_[j]) {
+            u_[match_[j]] += delta;
+            v_[j] -= delta;
+          } else {
+            min_slack_[j] -= delta;
+          }
+        }
+        j0 = j1;
+      } while (match_[j0] != 0);
+      do {
+        int j1 = way_[j0];
+        match_[j0] = match_[j1];
+        j0 = j1;
+      } while (j0 != 0);
+    }
+
+    for (int j = 1; j <= nd; ++j) {
+      int i = match_[j] - 1;
+      if (i < nt && cost_[i * n + j - 1] < forbidden) {
+        assigned_track_[local_tracks_[i]] = local_detections_[j - 1];
+        assigned_detection_[local_detections_[j - 1]] = local_tracks_[i];
+      }
+    }
+  }
+
+  std::vector<Track, Eigen::aligned_allocator<Track> > tracks_;
+  int next_id_;
+
+  // gate of the current round
+  double gate_;
+
+  // scratch buffers of one association round, kept to avoid reallocation
+  std::vector<MeasurementPackage> round_;
+  std::vector<Eigen::Vector2d, Eigen::aligned_allocator<Eigen::Vector2d> > positions_;
+  std::vector<Eigen::Matrix2d, Eigen::aligned_allocator<Eigen::Matrix2d> > noise_;
+  std::vector<std::pair<int64_t, int> > cells_;
+  std::vector<double> track_z_;
+  std::vector<double> track_S_inv_;
+  std::vector<Candidate> candidates_;
+  std::vector<int> parent_;
+  std::vector<int> assigned_track_;
+  std::vector<int> assigned_detection_;
+  std::vector<int> local_tracks_;
+  std::vector<int> local_detections_;
+  std::vector<double> cost_;
+  std::vector<double> u_, v_, min_slack_;
+  std::vector<int> match_, way_;
+  std::vector<char> used_;
+};
+
+#endif  // ASSOCIATION_H_
@@ -0,0 +1,265 @@
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "mapped_file.h"
+#include "ukf.h"
+
+/**
+ * Snapshots of a set of UKF tracks, so a replay can resume in the middle of
+ * a drive instead of running every measurement from the start.
+ *
+ * The file is a CheckpointFileHeader followed by checkpoints, each a
+ * CheckpointHeader and one fixed size CheckpointRecord per track. All fields
+ * are plain doubles and integers in host byte order, 8 byte aligned, so a
+ * mapped file is read in place without any parsing.
+ */
+struct CheckpointFileHeader {
+  enum { kVersion = 1 };
+
+  // "UKFC"
+  char magic[4];
+  uint32_t version;
+  // sizeof(CheckpointRecord) of the writer, a reader built differently rejects the file
+  uint32_t record_size;
+  uint32_t reserved;
+};
+
+struct CheckpointHeader {
+  int64_t timestamp;
+  uint32_t tracks;
+  uint32_t reserved;
+};
+
+struct CheckpointRecord {
+  enum Flags { kInitialized = 1, kUseLaser = 2, kUseRadar = 4, kUseSqrt = 8 };
+
+  int64_t time_us;
+  uint32_t flags;
+  uint32_t reserved;
+  double x[5];
+  // column major
+  double P[25];
+  // std_a, std_yawdd, std_laspx, std_laspy, std_radr, std_radphi, std_radrd
+  double noise[7];
+  double nis_laser;
+  double nis_radar;
+
+  void Pack(const UKF& ukf) {
+    time_us = ukf.time_us_;
+    flags = (ukf.is_initialized_ ? kInitialized : 0) | (ukf.use_laser_ ? kUseLaser : 0) |
+            (ukf.use_radar_ ? kUseRadar : 0) | (ukf.use_sqrt_ ? kUseSqrt : 0);
+    reserved = 0;
+    Eigen::Map<Eigen::Matrix<double, 5, 1> > x_map(x);
+    Eigen::Map<Eigen::Matrix<double, 5, 5> > P_map(P);
+    x_map = ukf.x_;
+    P_map = ukf.P_;
+    double values[7] = {ukf.std_a_, ukf.std_yawdd_, ukf.std_laspx_, ukf.std_laspy_,
+                        ukf.std_radr_, ukf.std_radphi_, ukf.std_radrd_};
+    std::copy(values, values + 7, noise);
+    nis_laser = ukf.NIS_laser_;
+    nis_radar = ukf.NIS_radar_;
+  }
+
+  /**
+   * Restores the track into an existing UKF. The sigma points and the
+   * square-root factor are not stored, the next Prediction derives them from
+   * x_ and P_ again.
+   */
+  void Unpack(UKF* ukf) const {
+    ukf->time_us_ = time_us;
+    ukf->is_initialized_ = flags & kInitialized;
+    ukf->use_laser_ = flags & kUseLaser;
+    ukf->use_radar_ = flags & kUseRadar;
+    ukf->use_sqrt_ = flags & kUseSqrt;
+    ukf->x_ = Eigen::Map<const Eigen::Matrix<double, 5, 1> >(x);
+    ukf->SetCovariance(Eigen::Map<const Eigen::Matrix<double, 5, 5> >(P));
+    ukf->std_a_ = noise[0];
+    ukf->std_yawdd_ = noise[1];
+    ukf->std_laspx_ = noise[2];
+    ukf->std_laspy_ = noise[3];
+    ukf->std_radr_ = noise[4];
+    ukf->std_radphi_ = noise[5];
+    ukf->std_radrd_ = noise[6];
+    ukf->NIS_laser_ = nis_laser;
+    ukf->NIS_radar_ = nis_radar;
+  }
+};
+
+static_assert(sizeof(CheckpointFileHeader) % 8 == 0 && sizeof(CheckpointHeader) % 8 == 0 && sizeof(CheckpointRecord) % 8 == 0,
+              "records are read in place and must keep doubles aligned");
+
+/**
+ * Appends checkpoints to a file, buffered by stdio
+ */
+class CheckpointWriter {
+ public:
+  CheckpointWriter() : file_(nullptr) {}
+
+  ~CheckpointWriter() {
+    Close();
+  }
+
+  CheckpointWriter(const CheckpointWriter&) = delete;
+  CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+  /**
+   * Creates or truncates the file and writes the file header
+   * @return false if the file could not be written
+   */
+  bool Open(const std::string& path) {
+    Close();
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == nullptr)
+      return false;
+    CheckpointFileHeader header;
+    std::memcpy(header.magic, "UKFC", 4);
+    header.version = CheckpointFileHeader::kVersion;
+    header.record_size = sizeof(CheckpointRecord);
+    header.reserved = 0;
+    return fwrite(&header, sizeof(header), 1, file_) == 1;
+  }
+
+  bool IsOpen() const {
+    return file_ != nullptr;
+  }
+
+  /**
+   * @param timestamp Time of the checkpoint in us, should not decrease
+   * @param ukfs Tracks in the order they are restored
+   * @return false on a write error
+   */
+  bool Write(long long timestamp, const std::vector<const UKF*>& ukfs) {
+    if (file_ == nullptr)
+      return false;
+    records_.resize(ukfs.size());
+    for (size_t i = 0; i < ukfs.size(); ++i)
+      records_[i].Pack(*ukfs[i]);
+    CheckpointHeader header;
+    header.timestamp = timestamp;
+    header.tracks = ukfs.size();
+    header.reserved = 0;
+    if (fwrite(&header, sizeof(header), 1, file_) != 1)
+      return false;
+    return records_.empty() || fwrite(records_.data(), sizeof(CheckpointRecord), records_.size(), file_) == records_.size();
+  }
+
+  /**
+   * Flushes buffered checkpoints, a reader opened afterwards sees them
+   */
+  bool Flush() {
+    return file_ != nullptr && fflush(file_) == 0;
+  }
+
+  void Close() {
+    if (file_ != nullptr)
+      fclose(file_);
+    file_ = nullptr;
+  }
+
+ private:
+  FILE* file_;
+  std::vector<CheckpointRecord> records_;
+};
+
+/**
+ * Maps a checkpoint file read only. Open indexes the checkpoint headers once,
+ * after that finding a checkpoint is a binary search and restoring a track
+ * copies one record straight out of the mapping.
+ */
+class CheckpointReader {
+ public:
+  /**
+   * @return false if the file can not be mapped or is not a checkpoint file
+   *     of this version. A truncated last checkpoint, e.g. of a writer that
+   *     is still running, is left out of the index.
+   */
+  bool Open(const std::string& path) {
+    Close();
+    if (!file_.Open(path))
+      return false;
+    if (file_.Size() < sizeof(CheckpointFileHeader)) {
+      Close();
+      return false;
+    }
+    const CheckpointFileHeader* header = reinterpret_cast<const CheckpointFileHeader*>(file_.Data());
+    if (std::memcmp(header->magic, "UKFC", 4) != 0 || header->version != CheckpointFileHeader::kVersion ||
+        header->record_size != sizeof(CheckpointRecord)) {
+      Close();
+      return false;
+    }
+    size_t offset = sizeof(CheckpointFileHeader);
+    while (offset + sizeof(CheckpointHeader) <= file_.Size()) {
+      const CheckpointHeader* checkpoint = reinterpret_cast<const CheckpointHeader*>(file_.Data() + offset);
+      size_t end = offset + sizeof(CheckpointHeader) + (size_t)checkpoint->tracks * sizeof(CheckpointRecord);
+      if (end > file_.Size())
+        break;
+      offsets_.push_back(offset);
+      timestamps_.push_back(checkpoint->timestamp);
+      offset = end;
+    }
+    return true;
+  }
+
+  void Close() {
+    file_.Close();
+    offsets_.clear();
+    timestamps_.clear();
+  }
+
+  /**
+   * @return Number of checkpoints
+   */
+  int Size() const {
+    return offsets_.size();
+  }
+
+  long long Timestamp(int checkpoint) const {
+    return timestamps_[checkpoint];
+  }
+
+  int Tracks(int checkpoint) const {
+    return Header(checkpoint).tracks;
+  }
+
+  /**
+   * @return The latest checkpoint at or before timestamp, -1 if there is none
+   */
+  int Find(long long timestamp) const {
+    return std::upper_bound(timestamps_.begin(), timestamps_.end(), (int64_t)timestamp) - timestamps_.begin() - 1;
+  }
+
+  const CheckpointRecord& Record(int checkpoint, int track) const {
+    const CheckpointRecord* records = reinterpret_cast<const CheckpointRecord*>(file_.Data() + offsets_[checkpoint] +
+                                                                               sizeof(CheckpointHeader));
+    return records[track];
+  }
+
+  /**
+   * Restores the first ukfs.size() tracks of a checkpoint
+   * @return false if the checkpoint holds fewer tracks
+   */
+  bool Restore(int checkpoint, const std::vector<UKF*>& ukfs) const {
+    if ((size_t)Tracks(checkpoint) < ukfs.size())
+      return false;
+    for (size_t i = 0; i < ukfs.size(); ++i)
+      Record(checkpoint, i).Unpack(ukfs[i]);
+    return true;
+  }
+
+ private:
+  const CheckpointHeader& Header(int checkpoint) const {
+    return *reinterpret_cast<const CheckpointHeader*>(file_.Data() + offsets_[checkpoint]);
+  }
+
+  MappedFile file_;
+  std::vector<size_t> offsets_;
+  std::vector<int64_t> timestamps_;
+};
+
+#endif  // CHECKPOINT_H_
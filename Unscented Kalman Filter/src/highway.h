@@ -4,6 +4,10 @@
 #include "render/render.h"
 #include "sensors/lidar.h"
 #include "tools.h"
+#include "association.h"
+#include "checkpoint.h"
+#include "pcd_archive.h"
+#include "scenario.h"
 
 class Highway
 {
@@ -16,6 +20,13 @@ public:
 	std::vector<double> rmseThreshold = {0.30,0.16,0.95,0.70};
 	std::vector<double> rmseFailLog = {0.0,0.0,0.0,0.0};
 	Lidar* lidar;
+	MultiTargetTracker tracker;
+	// motion of all cars in traffic, which hold a copy of their state for rendering and sensing
+	TrafficScenario scenario;
+	// reused for every frame read from pcdArchive
+	pcl::PointCloud<pcl::PointXYZ>::Ptr archiveCloud = pcl::PointCloud<pcl::PointXYZ>::Ptr(new pcl::PointCloud<pcl::PointXYZ>);
+	// with associate, car frames that had no confirmed track within 3 m and are not in the RMSE
+	int unscoredFrames = 0;
 	
 	// Parameters 
 	// --------------------------------
@@ -25,130 +36,203 @@ public:
 	bool visualize_lidar = true;
 	bool visualize_radar = true;
 	bool visualize_pcd = false;
+	// Read the pcd frames from an archive made by pcd_pack instead of one file per frame
+	PCDArchiveReader* pcdArchive = NULL;
 	// Predict path in the future using UKF
 	double projectedTime = 2;
 	int projectedSteps = 6;
+	// Hand all detections unlabeled to the multi-target tracker instead of each car's own UKF
+	bool associate = false;
+	// Snapshot the UKF of every car each frame, one slot per car in traffic order, e.g. to resume a replay midway
+	CheckpointWriter* checkpoints = NULL;
 	// --------------------------------
 
-	Highway(pcl::visualization::PCLVisualizer::Ptr& viewer)
+	// viewer may be null to run headless, nothing is rendered then. Without a scenario
+	// the highway gets the three cars it always had
+	Highway(pcl::visualization::PCLVisualizer::Ptr& viewer, const TrafficScenario* setScenario = NULL)
 	{
 
 		tools = Tools();
 	
 		egoCar = Car(Vect3(0, 0, 0), Vect3(4, 2, 2), Color(0, 1, 0), 0, 0, 2, "egoCar");
-		
-		Car car1(Vect3(-10, 4, 0), Vect3(4, 2, 2), Color(0, 0, 1), 5, 0, 2, "car1");
-		
-		std::vector<accuation> car1_instructions;
-		accuation a = accuation(0.5*1e6, 0.5, 0.0);
-		car1_instructions.push_back(a);
-		a = accuation(2.2*1e6, 0.0, -0.2);
-		car1_instructions.push_back(a);
-		a = accuation(3.3*1e6, 0.0, 0.2);
-		car1_instructions.push_back(a);
-		a = accuation(4.4*1e6, -2.0, 0.0);
-		car1_instructions.push_back(a);
-	
-		car1.setInstructions(car1_instructions);
-		if( trackCars[0] )
-		{
-			UKF ukf1;
-			car1.setUKF(ukf1);
-		}
-		traffic.push_back(car1);
-		
-		Car car2(Vect3(25, -4, 0), Vect3(4, 2, 2), Color(0, 0, 1), -6, 0, 2, "car2");
-		std::vector<accuation> car2_instructions;
-		a = accuation(4.0*1e6, 3.0, 0.0);
-		car2_instructions.push_back(a);
-		a = accuation(8.0*1e6, 0.0, 0.0);
-		car2_instructions.push_back(a);
-		car2.setInstructions(car2_instructions);
-		if( trackCars[1] )
+
+		if(setScenario)
+			scenario = *setScenario;
+		else
 		{
-			UKF ukf2;
-			car2.setUKF(ukf2);
+			int car1 = scenario.AddCar("car1", -10, 4, 5, 0);
+			scenario.AddActuation(car1, 0.5*1e6, 0.5, 0.0);
+			scenario.AddActuation(car1, 2.2*1e6, 0.0, -0.2);
+			scenario.AddActuation(car1, 3.3*1e6, 0.0, 0.2);
+			scenario.AddActuation(car1, 4.4*1e6, -2.0, 0.0);
+
+			int car2 = scenario.AddCar("car2", 25, -4, -6, 0);
+			scenario.AddActuation(car2, 4.0*1e6, 3.0, 0.0);
+			scenario.AddActuation(car2, 8.0*1e6, 0.0, 0.0);
+
+			int car3 = scenario.AddCar("car3", -12, 0, 1, 0);
+			scenario.AddActuation(car3, 0.5*1e6, 2.0, 1.0);
+			scenario.AddActuation(car3, 1.0*1e6, 2.5, 0.0);
+			scenario.AddActuation(car3, 3.2*1e6, 0.0, -1.0);
+			scenario.AddActuation(car3, 3.3*1e6, 2.0, 0.0);
+			scenario.AddActuation(car3, 4.5*1e6, 0.0, 0.0);
+			scenario.AddActuation(car3, 5.5*1e6, -2.0, 0.0);
+			scenario.AddActuation(car3, 7.5*1e6, 0.0, 0.0);
 		}
-		traffic.push_back(car2);
-	
-		Car car3(Vect3(-12, 0, 0), Vect3(4, 2, 2), Color(0, 0, 1), 1, 0, 2, "car3");
-		std::vector<accuation> car3_instructions;
-		a = accuation(0.5*1e6, 2.0, 1.0);
-		car3_instructions.push_back(a);
-		a = accuation(1.0*1e6, 2.5, 0.0);
-		car3_instructions.push_back(a);
-		a = accuation(3.2*1e6, 0.0, -1.0);
-		car3_instructions.push_back(a);
-		a = accuation(3.3*1e6, 2.0, 0.0);
-		car3_instructions.push_back(a);
-		a = accuation(4.5*1e6, 0.0, 0.0);
-		car3_instructions.push_back(a);
-		a = accuation(5.5*1e6, -2.0, 0.0);
-		car3_instructions.push_back(a);
-		a = accuation(7.5*1e6, 0.0, 0.0);
-		car3_instructions.push_back(a);
-		car3.setInstructions(car3_instructions);
-		if( trackCars[2] )
+
+		// cars beyond the listed ones are tracked too
+		trackCars.resize(scenario.Size(), true);
+		for (int i = 0; i < scenario.Size(); i++)
 		{
-			UKF ukf3;
-			car3.setUKF(ukf3);
+			Car car(Vect3(scenario.Px(i), scenario.Py(i), 0), Vect3(scenario.Length(i), scenario.Width(i), scenario.Height(i)), Color(0, 0, 1),
+				scenario.Velocity(i), scenario.Angle(i), scenario.Lf(i), scenario.Name(i));
+			if( trackCars[i] )
+			{
+				UKF ukf;
+				car.setUKF(ukf);
+			}
+			traffic.push_back(car);
 		}
-		traffic.push_back(car3);
 
-		lidar = new Lidar(traffic,0);
+		// the ray casting lidar is only needed for pcd generation, skip building its rays when headless
+		lidar = viewer ? new Lidar(traffic,0) : NULL;
 	
 		// render environment
-		renderHighway(0,viewer);
-		egoCar.render(viewer);
-		car1.render(viewer);
-		car2.render(viewer);
-		car3.render(viewer);
+		if(viewer)
+		{
+			renderHighway(0,viewer);
+			egoCar.render(viewer);
+			for (Car& car : traffic)
+				car.render(viewer);
+		}
 	}
 	
 	void stepHighway(double egoVelocity, long long timestamp, int frame_per_sec, pcl::visualization::PCLVisualizer::Ptr& viewer)
 	{
 
-		if(visualize_pcd)
+		if(visualize_pcd && viewer)
 		{
-			pcl::PointCloud<pcl::PointXYZ>::Ptr trafficCloud = tools.loadPcd("../src/sensors/data/pcd/highway_"+std::to_string(timestamp)+".pcd");
-			renderPointCloud(viewer, trafficCloud, "trafficCloud", Color((float)184/256,(float)223/256,(float)252/256));
+			pcl::PointCloud<pcl::PointXYZ>::Ptr trafficCloud;
+			if(pcdArchive)
+			{
+				if(pcdArchive->Load(timestamp, *archiveCloud))
+					trafficCloud = archiveCloud;
+			}
+			else
+				trafficCloud = tools.loadPcd("../src/sensors/data/pcd/highway_"+std::to_string(timestamp)+".pcd");
+			if(trafficCloud)
+				renderPointCloud(viewer, trafficCloud, "trafficCloud", Color((float)184/256,(float)223/256,(float)252/256));
 		}
 		
 
 		// render highway environment with poles
-		renderHighway(egoVelocity*timestamp/1e6, viewer);
-		egoCar.render(viewer);
+		if(viewer)
+		{
+			renderHighway(egoVelocity*timestamp/1e6, viewer);
+			egoCar.render(viewer);
+		}
 		
+		// move every car at once, then copy the new state to the cars for rendering and sensing
+		scenario.Step((double)1/frame_per_sec, timestamp);
+		std::vector<MeasurementPackage> detections;
 		for (int i = 0; i < traffic.size(); i++)
 		{
-			traffic[i].move((double)1/frame_per_sec, timestamp);
-			if(!visualize_pcd)
+			Car& car = traffic[i];
+			car.position.x = scenario.Px(i);
+			car.position.y = scenario.Py(i);
+			car.velocity = scenario.Velocity(i);
+			car.angle = scenario.Angle(i);
+			car.acceleration = scenario.Acceleration(i);
+			car.steering = scenario.Steering(i);
+			car.sinNegTheta = sin(-car.angle);
+			car.cosNegTheta = cos(-car.angle);
+			if(viewer)
+				car.orientation = car.getQuaternion(car.angle);
+			if(viewer && !visualize_pcd)
 				traffic[i].render(viewer);
 			// Sense surrounding cars with lidar and radar
+			if(trackCars[i])
+			{
+				// lidar and radar share the timestamp, predict once and fuse both in one update
+				std::vector<MeasurementPackage> frame;
+				tools.trackIndex = i;
+				tools.lidarSense(traffic[i], viewer, timestamp, viewer && visualize_lidar, &frame);
+				tools.radarSense(traffic[i], egoCar, viewer, timestamp, viewer && visualize_radar, &frame);
+				if(associate)
+					detections.insert(detections.end(), frame.begin(), frame.end());
+				else
+					traffic[i].ukf.ProcessMeasurements(frame);
+			}
+		}
+		if(associate)
+			tracker.ProcessDetections(detections);
+		else if(checkpoints)
+		{
+			std::vector<const UKF*> ukfs;
+			for (int i = 0; i < traffic.size(); i++)
+				ukfs.push_back(&traffic[i].ukf);
+			checkpoints->Write(timestamp, ukfs);
+		}
+
+		for (int i = 0; i < traffic.size(); i++)
+		{
 			if(trackCars[i])
 			{
 				VectorXd gt(4);
 				gt << traffic[i].position.x, traffic[i].position.y, traffic[i].velocity*cos(traffic[i].angle), traffic[i].velocity*sin(traffic[i].angle);
-				tools.ground_truth.push_back(gt);
-				tools.lidarSense(traffic[i], viewer, timestamp, visualize_lidar);
-				tools.radarSense(traffic[i], egoCar, viewer, timestamp, visualize_radar);
-				tools.ukfResults(traffic[i],viewer, projectedTime, projectedSteps);
+				if(tools.recorder)
+					tools.recorder->WriteGroundTruth(timestamp, i, gt);
+				const UKF& ukf = traffic[i].ukf;
+				VectorXd x = ukf.x_;
+				double nisLaser = ukf.NIS_laser_, nisRadar = ukf.NIS_radar_;
+				if(associate)
+				{
+					// score the confirmed track closest to the car, a car without one is counted as unscored
+					int track = tracker.Nearest(gt(0), gt(1), 3.0);
+					if(track < 0)
+					{
+						unscoredFrames++;
+						continue;
+					}
+					const CTRVFixedUKF& filter = tracker.Tracks()[track].filter;
+					x = filter.x_;
+					nisLaser = filter.NIS_laser_;
+					nisRadar = filter.NIS_radar_;
+					if(viewer)
+						viewer->addSphere(pcl::PointXYZ(x[0],x[1],3.5), 0.5, 0, 1, 0,"track"+std::to_string(tracker.Tracks()[track].id));
+				}
+				else if(viewer)
+					tools.ukfResults(traffic[i],viewer, projectedTime, projectedSteps);
 				VectorXd estimate(4);
-				double v  = traffic[i].ukf.x_(2);
-    			double yaw = traffic[i].ukf.x_(3);
+				double v  = x(2);
+    			double yaw = x(3);
     			double v1 = cos(yaw)*v;
     			double v2 = sin(yaw)*v;
-				estimate << traffic[i].ukf.x_[0], traffic[i].ukf.x_[1], v1, v2;
-				tools.estimations.push_back(estimate);
+				estimate << x[0], x[1], v1, v2;
+				tools.rmse.add(estimate, gt);
+				if(tools.keepHistory)
+				{
+					tools.estimations.push_back(estimate);
+					tools.ground_truth.push_back(gt);
+				}
+				// the first frame only initializes the filter
+				if(timestamp > 0)
+				{
+					tools.lidarNIS.add(nisLaser);
+					tools.radarNIS.add(nisRadar);
+				}
 	
 			}
 		}
-		viewer->addText("Accuracy - RMSE:", 30, 300, 20, 1, 1, 1, "rmse");
-		VectorXd rmse = tools.CalculateRMSE(tools.estimations, tools.ground_truth);
-		viewer->addText(" X: "+std::to_string(rmse[0]), 30, 275, 20, 1, 1, 1, "rmse_x");
-		viewer->addText(" Y: "+std::to_string(rmse[1]), 30, 250, 20, 1, 1, 1, "rmse_y");
-		viewer->addText("Vx: "	+std::to_string(rmse[2]), 30, 225, 20, 1, 1, 1, "rmse_vx");
-		viewer->addText("Vy: "	+std::to_string(rmse[3]), 30, 200, 20, 1, 1, 1, "rmse_vy");
+		VectorXd rmse = tools.rmse.rmse();
+		if(viewer)
+		{
+			viewer->addText("Accuracy - RMSE:", 30, 300, 20, 1, 1, 1, "rmse");
+			viewer->addText(" X: "+std::to_string(rmse[0]), 30, 275, 20, 1, 1, 1, "rmse_x");
+			viewer->addText(" Y: "+std::to_string(rmse[1]), 30, 250, 20, 1, 1, 1, "rmse_y");
+			viewer->addText("Vx: "	+std::to_string(rmse[2]), 30, 225, 20, 1, 1, 1, "rmse_vx");
+			viewer->addText("Vy: "	+std::to_string(rmse[3]), 30, 200, 20, 1, 1, 1, "rmse_vy");
+		}
 
 		if(timestamp > 1.0e6)
 		{
@@ -174,7 +258,7 @@ public:
 				pass = false;
 			}
 		}
-		if(!pass)
+		if(!pass && viewer)
 		{
 			viewer->addText("RMSE Failed Threshold", 30, 150, 20, 1, 0, 0, "rmse_fail");
 			if(rmseFailLog[0] > 0)
@@ -16,7 +16,29 @@ int main(int argc, char** argv)
 	float x_pos = 0;
 	viewer->setCameraPosition ( x_pos-26, 0, 15.0, x_pos+25, 0, 0, 0, 0, 1);
 
-	Highway highway(viewer);
+	// --associate feeds all detections unlabeled to the multi-target tracker,
+	// traffic comes from a scenario file if one is given, e.g. ../src/scenarios/highway.txt
+	bool associate = false;
+	const char* scenarioPath = NULL;
+	for(int i = 1; i < argc; i++)
+	{
+		if(std::string(argv[i]) == "--associate")
+			associate = true;
+		else
+			scenarioPath = argv[i];
+	}
+	TrafficScenario scenario;
+	if(scenarioPath && !scenario.Load(scenarioPath))
+	{
+		std::cerr << scenario.error() << std::endl;
+		return 1;
+	}
+	Highway highway(viewer, scenarioPath ? &scenario : NULL);
+	highway.associate = associate;
+	// with visualize_pcd, prefer the packed frames when pcd_pack has been run
+	PCDArchiveReader pcdArchive;
+	if(pcdArchive.Open("../src/sensors/data/pcd/highway.pcda"))
+		highway.pcdArchive = &pcdArchive;
 
 	//initHighway(viewer);
 
@@ -39,5 +61,7 @@ int main(int argc, char** argv)
 		time_us = 1000000*frame_count/frame_per_sec;
 		
 	}
+	if(associate)
+		std::cout << highway.unscoredFrames << " car frames had no confirmed track within 3 m and are not in the RMSE" << std::endl;
 
 }
\ No newline at end of file
@@ -0,0 +1,217 @@
+#ifndef MEASUREMENT_LOG_H_
+#define MEASUREMENT_LOG_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "mapped_file.h"
+#include "measurement_package.h"
+
+/**
+ * Recorded sensor stream, so a run can be replayed through the filters as
+ * fast as they go instead of in real time.
+ *
+ * The file is a MeasurementLogHeader followed by fixed size
+ * MeasurementRecords in arrival order. Ground truth records sit in the same
+ * stream, written after the measurements of their frame, so a replay can
+ * score the filters at the same points as the recorded run. Fields are in
+ * host byte order and 8 byte aligned, a mapped log is read in place.
+ */
+struct MeasurementLogHeader {
+  enum { kVersion = 1 };
+
+  // "UKFM"
+  char magic[4];
+  uint32_t version;
+  // sizeof(MeasurementRecord) of the writer, a reader built differently rejects the file
+  uint32_t record_size;
+  uint32_t reserved;
+};
+
+struct MeasurementRecord {
+  enum Type { kLaser = MeasurementPackage::LASER, kRadar = MeasurementPackage::RADAR, kGroundTruth };
+  enum { kMaxValues = 4 };
+
+  int64_t timestamp;
+  uint32_t type;
+  // the car or track the record belongs to, -1 if unknown
+  int32_t track;
+  // lidar px py, radar rho phi rho_dot, ground truth px py vx vy
+  double values[kMaxValues];
+
+  int Size() const {
+    return type == kLaser ? 2 : type == kRadar ? 3 : 4;
+  }
+
+  /**
+   * @return false for a ground truth record, which is no measurement
+   */
+  bool ToPackage(MeasurementPackage* meas_package) const {
+    if (type == kGroundTruth)
+      return false;
+    meas_package->timestamp_ = timestamp;
+    meas_package->sensor_type_ = static_cast<MeasurementPackage::SensorType>(type);
+    meas_package->raw_measurements_ = Eigen::Map<const Eigen::VectorXd>(values, Size());
+    return true;
+  }
+};
+
+static_assert(sizeof(MeasurementLogHeader) % 8 == 0 && sizeof(MeasurementRecord) % 8 == 0,
+              "records are read in place and must keep doubles aligned");
+
+/**
+ * Appends records to a log, buffered by stdio
+ */
+class MeasurementLogWriter {
+ public:
+  MeasurementLogWriter() : file_(nullptr), records_(0) {}
+
+  ~MeasurementLogWriter() {
+    Close();
+  }
+
+  MeasurementLogWriter(const MeasurementLogWriter&) = delete;
+  MeasurementLogWriter& operator=(const MeasurementLogWriter&) = delete;
+
+  /**
+   * Creates or truncates the log and writes the header
+   * @return false if the file could not be written
+   */
+  bool Open(const std::string& path) {
+    Close();
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == nullptr)
+      return false;
+    MeasurementLogHeader header;
+    std::memcpy(header.magic, "UKFM", 4);
+    header.version = MeasurementLogHeader::kVersion;
+    header.record_size = sizeof(MeasurementRecord);
+    header.reserved = 0;
+    return fwrite(&header, sizeof(header), 1, file_) == 1;
+  }
+
+  bool IsOpen() const {
+    return file_ != nullptr;
+  }
+
+  /**
+   * @param track Track hint stored with the measurement
+   * @return false on a write error
+   */
+  bool Write(const MeasurementPackage& meas_package, int track) {
+    MeasurementRecord record;
+    record.type = meas_package.sensor_type_;
+    int size = std::min<int>(meas_package.raw_measurements_.size(), MeasurementRecord::kMaxValues);
+    std::copy(meas_package.raw_measurements_.data(), meas_package.raw_measurements_.data() + size, record.values);
+    return Append(meas_package.timestamp_, track, size, &record);
+  }
+
+  /**
+   * @param truth px py vx vy of the car
+   */
+  bool WriteGroundTruth(long long timestamp, int track, const Eigen::VectorXd& truth) {
+    MeasurementRecord record;
+    record.type = MeasurementRecord::kGroundTruth;
+    int size = std::min<int>(truth.size(), MeasurementRecord::kMaxValues);
+    std::copy(truth.data(), truth.data() + size, record.values);
+    return Append(timestamp, track, size, &record);
+  }
+
+  /**
+   * @return Number of records written since Open
+   */
+  size_t Records() const {
+    return records_;
+  }
+
+  bool Flush() {
+    return file_ != nullptr && fflush(file_) == 0;
+  }
+
+  void Close() {
+    if (file_ != nullptr)
+      fclose(file_);
+    file_ = nullptr;
+    records_ = 0;
+  }
+
+ private:
+  bool Append(long long timestamp, int track, int size, MeasurementRecord* record) {
+    if (file_ == nullptr)
+      return false;
+    record->timestamp = timestamp;
+    record->track = track;
+    std::fill(record->values + size, record->values + MeasurementRecord::kMaxValues, 0.0);
+    records_++;
+    return fwrite(record, sizeof(MeasurementRecord), 1, file_) == 1;
+  }
+
+  FILE* file_;
+  size_t records_;
+};
+
+/**
+ * Maps a log read only, records are accessed in place
+ */
+class MeasurementLogReader {
+ public:
+  MeasurementLogReader() : records_(nullptr), size_(0) {}
+
+  /**
+   * @return false if the file can not be mapped or is not a log of this
+   *     version. A partly written last record is ignored.
+   */
+  bool Open(const std::string& path) {
+    Close();
+    if (!file_.Open(path))
+      return false;
+    if (file_.Size() < sizeof(MeasurementLogHeader)) {
+      Close();
+      return false;
+    }
+    const MeasurementLogHeader* header = reinterpret_cast<const MeasurementLogHeader*>(file_.Data());
+    if (std::memcmp(header->magic, "UKFM", 4) != 0 || header->version != MeasurementLogHeader::kVersion ||
+        header->record_size != sizeof(MeasurementRecord)) {
+      Close();
+      return false;
+    }
+    records_ = reinterpret_cast<const MeasurementRecord*>(file_.Data() + sizeof(MeasurementLogHeader));
+    size_ = (file_.Size() - sizeof(MeasurementLogHeader)) / sizeof(MeasurementRecord);
+    return true;
+  }
+
+  void Close() {
+    file_.Close();
+    records_ = nullptr;
+    size_ = 0;
+  }
+
+  size_t Size() const {
+    return size_;
+  }
+
+  const MeasurementRecord& operator[](size_t index) const {
+    return records_[index];
+  }
+
+  /**
+   * @return Index of the first record after timestamp, e.g. where to resume
+   *     from a checkpoint taken at timestamp. Needs records in time order.
+   */
+  size_t FindAfter(long long timestamp) const {
+    const MeasurementRecord* it = std::upper_bound(records_, records_ + size_, (int64_t)timestamp,
+                                                   [](int64_t t, const MeasurementRecord& record) {
+                                                     return t < record.timestamp;
+                                                   });
+    return it - records_;
+  }
+
+ private:
+  MappedFile file_;
+  const MeasurementRecord* records_;
+  size_t size_;
+};
+
+#endif  // MEASUREMENT_LOG_H_
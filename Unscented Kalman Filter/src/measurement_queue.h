@@ -0,0 +1,341 @@
+#ifndef MEASUREMENT_QUEUE_H_
+#define MEASUREMENT_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "measurement_package.h"
+#include "ukf.h"
+
+/**
+ * Bounded lock-free queue for many producers and one consumer. Every cell
+ * carries a sequence number that tells producers whether it is free and the
+ * consumer whether it is filled, so neither side ever takes a lock.
+ */
+template <typename T>
+class MPSCQueue {
+ public:
+  /**
+   * @param capacity Number of cells, rounded up to a power of two
+   */
+  explicit MPSCQueue(size_t capacity) : head_(0), tail_(0) {
+    size_t size = 2;
+    while (size < capacity)
+      size *= 2;
+    mask_ = size - 1;
+    cells_ = std::vector<Cell>(size);
+    for (size_t i = 0; i < size; ++i)
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  MPSCQueue(const MPSCQueue&) = delete;
+  MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+  /**
+   * Safe from any number of threads
+   * @return false if the queue is full
+   */
+  bool TryPush(const T& value) {
+    size_t pos = tail_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+      cell = &cells_[pos & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = tail_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = value;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Consumer thread only
+   * @return false if the queue is empty
+   */
+  bool TryPop(T& value) {
+    size_t pos = head_.load(std::memory_order_relaxed);
+    Cell& cell = cells_[pos & mask_];
+    size_t sequence = cell.sequence.load(std::memory_order_acquire);
+    if ((intptr_t)sequence - (intptr_t)(pos + 1) < 0)
+      return false;
+    value = cell.value;
+    cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+    head_.store(pos + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * Approximate number of queued items, may be read from any thread
+   */
+  size_t Size() const {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+
+  size_t Capacity() const {
+    return mask_ + 1;
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  std::vector<Cell> cells_;
+  size_t mask_;
+  // consumer and producer positions on separate cache lines
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+};
+
+/**
+ * A measurement as it travels through the front end. Unlike
+ * MeasurementPackage it holds its values inline, so copying one into a queue
+ * cell never allocates, whichever sensor the cell held before.
+ */
+struct QueuedMeasurement {
+  enum { kMaxSize = 3 };
+
+  long long timestamp;
+  MeasurementPackage::SensorType sensor_type;
+  int size;
+  // lidar px py, radar rho phi rho_dot
+  double z[kMaxSize];
+
+  QueuedMeasurement() : timestamp(0), sensor_type(MeasurementPackage::LASER), size(0) {}
+
+  explicit QueuedMeasurement(const MeasurementPackage& meas_package)
+      : timestamp(meas_package.timestamp_), sensor_type(meas_package.sensor_type_),
+        size(std::min((int)meas_package.raw_measurements_.size(), (int)kMaxSize)) {
+    std::copy(meas_package.raw_measurements_.data(), meas_package.raw_measurements_.data() + size, z);
+  }
+
+  /**
+   * Fills meas_package, which only allocates if it held the other sensor's size
+   */
+  void CopyTo(MeasurementPackage& meas_package) const {
+    meas_package.timestamp_ = timestamp;
+    meas_package.sensor_type_ = sensor_type;
+    meas_package.raw_measurements_ = Eigen::Map<const Eigen::VectorXd>(z, size);
+  }
+};
+
+/**
+ * Holds measurements back until nothing older can be expected, so packets
+ * that arrive slightly out of order still reach the filter in timestamp
+ * order. A measurement is released once one at least window_us newer has
+ * been seen; anything older than what was already released is late.
+ */
+class ReorderBuffer {
+ public:
+  enum PushResult { kInOrder, kReordered, kLate };
+
+  explicit ReorderBuffer(long long window_us)
+      : window_us_(window_us), newest_(LLONG_MIN), released_(LLONG_MIN), arrival_(0) {}
+
+  PushResult Push(const QueuedMeasurement& meas_package) {
+    if (meas_package.timestamp < released_)
+      return kLate;
+    PushResult result = meas_package.timestamp < newest_ ? kReordered : kInOrder;
+    newest_ = std::max(newest_, meas_package.timestamp);
+    heap_.push_back(Entry(meas_package, arrival_++));
+    std::push_heap(heap_.begin(), heap_.end(), Later());
+    return result;
+  }
+
+  /**
+   * Appends released measurements to out, oldest first. Equal timestamps
+   * keep their arrival order.
+   * @param flush Release everything, e.g. when the stream ends
+   */
+  void Release(std::vector<QueuedMeasurement>& out, bool flush) {
+    while (!heap_.empty()) {
+      long long timestamp = heap_.front().meas.timestamp;
+      if (!flush && timestamp > newest_ - window_us_)
+        break;
+      std::pop_heap(heap_.begin(), heap_.end(), Later());
+      out.push_back(heap_.back().meas);
+      heap_.pop_back();
+      released_ = timestamp;
+    }
+  }
+
+  size_t Size() const {
+    return heap_.size();
+  }
+
+ private:
+  struct Entry {
+    Entry(const QueuedMeasurement& setMeas, uint64_t setArrival) : meas(setMeas), arrival(setArrival) {}
+    QueuedMeasurement meas;
+    uint64_t arrival;
+  };
+
+  // min heap on (timestamp, arrival)
+  struct Later {
+    bool operator()(const Entry& a, const Entry& b) const {
+      return a.meas.timestamp > b.meas.timestamp ||
+             (a.meas.timestamp == b.meas.timestamp && a.arrival > b.arrival);
+    }
+  };
+
+  long long window_us_;
+  long long newest_;
+  long long released_;
+  uint64_t arrival_;
+  std::vector<Entry> heap_;
+};
+
+/**
+ * Measurement front end for one UKF. Sensor driver threads call Push, a
+ * dedicated filter thread drains the queue through a ReorderBuffer and
+ * applies the measurements, grouping those with the same timestamp into one
+ * UKF::ProcessMeasurements call. While running, the UKF must only be read
+ * through Snapshot.
+ */
+class MeasurementFrontEnd {
+ public:
+  struct Counters {
+    uint64_t pushed;        // accepted by Push
+    uint64_t dropped_full;  // rejected by Push because the queue was full
+    uint64_t reordered;     // arrived after a newer one but inside the window
+    uint64_t late;          // arrived after a newer one was applied, dropped
+    uint64_t applied;       // handed to the filter
+  };
+
+  /**
+   * @param ukf The filter fed by this front end, must outlive it
+   * @param window_us Latency window of the reorder buffer in us
+   * @param capacity Queue size
+   */
+  MeasurementFrontEnd(UKF& ukf, long long window_us = 50000, size_t capacity = 1024)
+      : ukf_(ukf), queue_(capacity), reorder_(window_us), running_(false),
+        pushed_(0), dropped_full_(0), reordered_(0), late_(0), applied_(0) {}
+
+  ~MeasurementFrontEnd() {
+    Stop();
+  }
+
+  void Start() {
+    if (running_.exchange(true))
+      return;
+    thread_ = std::thread(&MeasurementFrontEnd::Run, this);
+  }
+
+  /**
+   * Stops the filter thread after applying everything queued so far,
+   * including what the reorder buffer still holds
+   */
+  void Stop() {
+    if (!running_.exchange(false))
+      return;
+    thread_.join();
+  }
+
+  /**
+   * Queues a measurement, safe from any thread
+   * @return false if the queue was full and the measurement was dropped
+   */
+  bool Push(const MeasurementPackage& meas_package) {
+    if (!queue_.TryPush(QueuedMeasurement(meas_package))) {
+      dropped_full_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    pushed_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  size_t QueueDepth() const {
+    return queue_.Size();
+  }
+
+  Counters GetCounters() const {
+    Counters counters;
+    counters.pushed = pushed_.load(std::memory_order_relaxed);
+    counters.dropped_full = dropped_full_.load(std::memory_order_relaxed);
+    counters.reordered = reordered_.load(std::memory_order_relaxed);
+    counters.late = late_.load(std::memory_order_relaxed);
+    counters.applied = applied_.load(std::memory_order_relaxed);
+    return counters;
+  }
+
+  /**
+   * Copy of the filter, consistent between two measurement updates
+   */
+  UKF Snapshot() {
+    std::lock_guard<std::mutex> lock(ukf_mutex_);
+    return ukf_;
+  }
+
+ private:
+  void Run() {
+    QueuedMeasurement meas_package;
+    std::vector<QueuedMeasurement> ready;
+    std::vector<MeasurementPackage> group;
+    for (;;) {
+      // read the flag first so nothing pushed before Stop is missed
+      bool stopping = !running_.load(std::memory_order_acquire);
+
+      bool popped = false;
+      while (queue_.TryPop(meas_package)) {
+        popped = true;
+        ReorderBuffer::PushResult result = reorder_.Push(meas_package);
+        if (result == ReorderBuffer::kLate)
+          late_.fetch_add(1, std::memory_order_relaxed);
+        else if (result == ReorderBuffer::kReordered)
+          reordered_.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      ready.clear();
+      reorder_.Release(ready, stopping);
+      for (size_t begin = 0; begin < ready.size();) {
+        size_t end = begin + 1;
+        while (end < ready.size() && ready[end].timestamp == ready[begin].timestamp)
+          ++end;
+        group.resize(end - begin);
+        for (size_t i = begin; i < end; ++i)
+          ready[i].CopyTo(group[i - begin]);
+        {
+          std::lock_guard<std::mutex> lock(ukf_mutex_);
+          ukf_.ProcessMeasurements(group);
+        }
+        applied_.fetch_add(end - begin, std::memory_order_relaxed);
+        begin = end;
+      }
+
+      if (stopping)
+        return;
+      if (!popped)
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+
+  UKF& ukf_;
+  std::mutex ukf_mutex_;
+  MPSCQueue<QueuedMeasurement> queue_;
+  ReorderBuffer reorder_;
+  std::thread thread_;
+  std::atomic<bool> running_;
+  std::atomic<uint64_t> pushed_;
+  std::atomic<uint64_t> dropped_full_;
+  std::atomic<uint64_t> reordered_;
+  std::atomic<uint64_t> late_;
+  std::atomic<uint64_t> applied_;
+};
+
+#endif  // MEASUREMENT_QUEUE_H_
@@ -0,0 +1,152 @@
+// Headless Monte Carlo runs of the Highway scenario for tuning the UKF.
+// Every run moves, senses and filters the cars exactly like main.cpp, but
+// without a viewer and with its own noise seed and process noise setting.
+// Run k of every setting uses seed k + 1, so settings are compared on the
+// same noise draws.
+// With --associate the multi-target tracker is scored instead of the per-car
+// UKFs, car frames without a confirmed track are reported as unscored.
+// Usage: ukf_monte_carlo [--associate] [runs per setting] [threads] [std_a list] [std_yawdd list] [scenario file]
+//   e.g. ukf_monte_carlo 200 0 1,2,3 0.5,1 ../src/scenarios/highway.txt
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include "highway.h"
+#include "thread_pool.h"
+
+struct RunResult {
+  Eigen::Vector4d rmse;
+  bool pass;
+  double nis_laser_mean;
+  double nis_radar_mean;
+  // fraction of updates with NIS above the 95% bound
+  double nis_laser_over;
+  double nis_radar_over;
+  // car frames left out of the RMSE, only with associate
+  int unscored_frames;
+};
+
+RunResult runHighway(double std_a, double std_yawdd, long long seed, const TrafficScenario* scenario, bool associate) {
+  pcl::visualization::PCLVisualizer::Ptr viewer;
+  Highway highway(viewer, scenario);
+  highway.tools.noiseSeed = seed;
+  highway.associate = associate;
+  for (Car& car : highway.traffic) {
+    car.ukf.std_a_ = std_a;
+    car.ukf.std_yawdd_ = std_yawdd;
+  }
+
+  // same timing as main.cpp
+  int frame_per_sec = 30;
+  int sec_interval = 10;
+  double egoVelocity = 25;
+
+  for (int frame_count = 0; frame_count < frame_per_sec * sec_interval; frame_count++) {
+    long long time_us = 1000000LL * frame_count / frame_per_sec;
+    highway.stepHighway(egoVelocity, time_us, frame_per_sec, viewer);
+  }
+
+  // stepHighway keeps running metrics, nothing to recompute here
+  const Tools& tools = highway.tools;
+  RunResult result;
+  result.rmse = tools.rmse.rmse();
+  result.pass = highway.pass;
+  result.nis_laser_mean = tools.lidarNIS.mean();
+  result.nis_radar_mean = tools.radarNIS.mean();
+  result.nis_laser_over = tools.lidarNIS.percentAbove() / 100;
+  result.nis_radar_over = tools.radarNIS.percentAbove() / 100;
+  result.unscored_frames = highway.unscoredFrames;
+  return result;
+}
+
+std::vector<double> parseList(const char* text) {
+  std::vector<double> values;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ','))
+    values.push_back(atof(item.c_str()));
+  return values;
+}
+
+int main(int argc, char** argv) {
+  bool associate = false;
+  std::vector<char*> args;
+  for (int i = 0; i < argc; i++) {
+    if (std::string(argv[i]) == "--associate")
+      associate = true;
+    else
+      args.push_back(argv[i]);
+  }
+  argc = args.size();
+  argv = args.data();
+
+  int runs = argc > 1 ? atoi(argv[1]) : 100;
+  int threads = argc > 2 ? atoi(argv[2]) : 0;
+  std::vector<double> std_a_values = parseList(argc > 3 ? argv[3] : "2");
+  std::vector<double> std_yawdd_values = parseList(argc > 4 ? argv[4] : "1");
+  if (runs <= 0 || std_a_values.empty() || std_yawdd_values.empty()) {
+    std::cerr << "Usage: ukf_monte_carlo [--associate] [runs per setting > 0] [threads] [std_a list] [std_yawdd list] [scenario file]"
+              << std::endl;
+    return 1;
+  }
+  TrafficScenario scenario;
+  if (argc > 5 && !scenario.Load(argv[5])) {
+    std::cerr << scenario.error() << std::endl;
+    return 1;
+  }
+
+  std::vector<std::pair<double, double> > settings;
+  for (double std_a : std_a_values)
+    for (double std_yawdd : std_yawdd_values)
+      settings.push_back(std::make_pair(std_a, std_yawdd));
+
+  size_t jobs = settings.size() * runs;
+  std::vector<RunResult> results(jobs);
+  ThreadPool pool(threads);
+
+  auto startTime = std::chrono::steady_clock::now();
+  pool.ParallelFor(jobs, 1, [&](size_t begin, size_t end) {
+    for (size_t job = begin; job < end; job++) {
+      const std::pair<double, double>& setting = settings[job / runs];
+      results[job] = runHighway(setting.first, setting.second, job % runs + 1, argc > 5 ? &scenario : nullptr, associate);
+    }
+  });
+  auto endTime = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(endTime - startTime).count();
+
+  std::cout << "std_a std_yawdd | RMSE mean (stddev) X Y Vx Vy | pass rate | NIS mean lidar radar | NIS > 95% lidar radar"
+            << (associate ? " | unscored car frames per run" : "") << std::endl;
+  for (size_t s = 0; s < settings.size(); s++) {
+    Eigen::Vector4d sum = Eigen::Vector4d::Zero();
+    Eigen::Vector4d sum_sq = Eigen::Vector4d::Zero();
+    double passed = 0, nis_laser = 0, nis_radar = 0, over_laser = 0, over_radar = 0, unscored = 0;
+    for (int run = 0; run < runs; run++) {
+      const RunResult& result = results[s * runs + run];
+      sum += result.rmse;
+      sum_sq += result.rmse.cwiseProduct(result.rmse);
+      passed += result.pass;
+      nis_laser += result.nis_laser_mean;
+      nis_radar += result.nis_radar_mean;
+      over_laser += result.nis_laser_over;
+      over_radar += result.nis_radar_over;
+      unscored += result.unscored_frames;
+    }
+    Eigen::Vector4d mean = sum / runs;
+    Eigen::Vector4d stddev = (sum_sq / runs - mean.cwiseProduct(mean)).cwiseMax(0.0).cwiseSqrt();
+
+    std::cout << settings[s].first << " " << settings[s].second << " |";
+    for (int k = 0; k < 4; k++)
+      std::cout << " " << mean[k] << " (" << stddev[k] << ")";
+    std::cout << " | " << 100 * passed / runs << "% | " << nis_laser / runs << " " << nis_radar / runs
+              << " | " << 100 * over_laser / runs << "% " << 100 * over_radar / runs << "%";
+    if (associate)
+      std::cout << " | " << unscored / runs;
+    std::cout << std::endl;
+  }
+  std::cout << jobs << " runs on " << pool.Size() << " threads took " << seconds << " s, "
+            << jobs / seconds << " runs/s" << std::endl;
+  return 0;
+}
@@ -0,0 +1,230 @@
+#ifndef PCD_ARCHIVE_H_
+#define PCD_ARCHIVE_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+#include "mapped_file.h"
+
+/**
+ * A sequence of point clouds in one file, so PCD playback needs neither a
+ * file open nor any parsing per frame.
+ *
+ * The file is a PCDArchiveHeader, the points of every frame and an index of
+ * PCDArchiveEntry sorted by timestamp at the end. Points are stored in the
+ * memory layout of pcl::PointXYZ, x y z and one padding float, and every
+ * frame starts 16 byte aligned.
+ */
+struct PCDArchiveHeader {
+  enum { kVersion = 1 };
+
+  // "UKFP"
+  char magic[4];
+  uint32_t version;
+  // bytes per point
+  uint32_t point_size;
+  uint32_t frames;
+  uint64_t index_offset;
+  uint64_t reserved;
+};
+
+struct PCDArchiveEntry {
+  int64_t timestamp;
+  uint64_t offset;
+  uint64_t points;
+};
+
+static_assert(sizeof(pcl::PointXYZ) == 16, "points are copied as whole pcl::PointXYZ");
+static_assert(sizeof(PCDArchiveHeader) % 16 == 0, "the first frame must start 16 byte aligned");
+
+/**
+ * Packs clouds into an archive. Frames may be added in any order, the index
+ * is sorted when the archive is closed.
+ */
+class PCDArchiveWriter {
+ public:
+  PCDArchiveWriter() : file_(nullptr), offset_(0) {}
+
+  ~PCDArchiveWriter() {
+    Close();
+  }
+
+  PCDArchiveWriter(const PCDArchiveWriter&) = delete;
+  PCDArchiveWriter& operator=(const PCDArchiveWriter&) = delete;
+
+  /**
+   * Creates or truncates the archive, the header is only complete after Close
+   * @return false if the file could not be written
+   */
+  bool Open(const std::string& path) {
+    Close();
+    file_ = fopen(path.c_str(), "wb");
+    if (file_ == nullptr)
+      return false;
+    PCDArchiveHeader header = Header();
+    offset_ = sizeof(header);
+    return fwrite(&header, sizeof(header), 1, file_) == 1;
+  }
+
+  /**
+   * @return false on a write error
+   */
+  bool Add(long long timestamp, const pcl::PointCloud<pcl::PointXYZ>& cloud) {
+    if (file_ == nullptr)
+      return false;
+    PCDArchiveEntry entry;
+    entry.timestamp = timestamp;
+    entry.offset = offset_;
+    entry.points = cloud.points.size();
+    entries_.push_back(entry);
+    offset_ += entry.points * sizeof(pcl::PointXYZ);
+    return entry.points == 0 || fwrite(cloud.points.data(), sizeof(pcl::PointXYZ), entry.points, file_) == entry.points;
+  }
+
+  /**
+   * Writes the index and completes the header
+   * @return false if the archive could not be completed
+   */
+  bool Close() {
+    if (file_ == nullptr)
+      return false;
+    std::sort(entries_.begin(), entries_.end(), [](const PCDArchiveEntry& a, const PCDArchiveEntry& b) {
+      return a.timestamp < b.timestamp;
+    });
+    PCDArchiveHeader header = Header();
+    header.frames = entries_.size();
+    header.index_offset = offset_;
+    bool ok = (entries_.empty() || fwrite(entries_.data(), sizeof(PCDArchiveEntry), entries_.size(), file_) == entries_.size()) &&
+              fseek(file_, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file_) == 1;
+    ok = fclose(file_) == 0 && ok;
+    file_ = nullptr;
+    entries_.clear();
+    return ok;
+  }
+
+ private:
+  static PCDArchiveHeader Header() {
+    PCDArchiveHeader header;
+    std::memcpy(header.magic, "UKFP", 4);
+    header.version = PCDArchiveHeader::kVersion;
+    header.point_size = sizeof(pcl::PointXYZ);
+    header.frames = 0;
+    header.index_offset = 0;
+    header.reserved = 0;
+    return header;
+  }
+
+  FILE* file_;
+  uint64_t offset_;
+  std::vector<PCDArchiveEntry> entries_;
+};
+
+/**
+ * Maps an archive read only. The points of a frame can be read in place
+ * through Points. pcl::PointCloud always owns its points, so Load copies a
+ * frame into a cloud with a single memcpy and reuses the cloud's buffer.
+ */
+class PCDArchiveReader {
+ public:
+  PCDArchiveReader() : entries_(nullptr), frames_(0) {}
+
+  /**
+   * @return false if the file can not be mapped, is not an archive of this
+   *     version or has an index or frame that reaches past its end
+   */
+  bool Open(const std::string& path) {
+    Close();
+    if (!file_.Open(path))
+      return false;
+    if (file_.Size() < sizeof(PCDArchiveHeader)) {
+      Close();
+      return false;
+    }
+    const PCDArchiveHeader* header = reinterpret_cast<const PCDArchiveHeader*>(file_.Data());
+    if (std::memcmp(header->magic, "UKFP", 4) != 0 ||
+        header->version != PCDArchiveHeader::kVersion || header->point_size != sizeof(pcl::PointXYZ) ||
+        header->index_offset > file_.Size() ||
+        header->frames > (file_.Size() - header->index_offset) / sizeof(PCDArchiveEntry)) {
+      Close();
+      return false;
+    }
+    // sizes are compared by division so a corrupt entry can not overflow them
+    const PCDArchiveEntry* entries = reinterpret_cast<const PCDArchiveEntry*>(file_.Data() + header->index_offset);
+    for (uint32_t frame = 0; frame < header->frames; frame++) {
+      if (entries[frame].offset > file_.Size() ||
+          entries[frame].points > (file_.Size() - entries[frame].offset) / sizeof(pcl::PointXYZ)) {
+        Close();
+        return false;
+      }
+    }
+    entries_ = entries;
+    frames_ = header->frames;
+    return true;
+  }
+
+  void Close() {
+    file_.Close();
+    entries_ = nullptr;
+    frames_ = 0;
+  }
+
+  int Size() const {
+    return frames_;
+  }
+
+  long long Timestamp(int frame) const {
+    return entries_[frame].timestamp;
+  }
+
+  /**
+   * @return The frame recorded at timestamp, -1 if there is none
+   */
+  int Find(long long timestamp) const {
+    const PCDArchiveEntry* it = std::lower_bound(entries_, entries_ + frames_, (int64_t)timestamp,
+                                                 [](const PCDArchiveEntry& entry, int64_t t) {
+                                                   return entry.timestamp < t;
+                                                 });
+    return it != entries_ + frames_ && it->timestamp == timestamp ? it - entries_ : -1;
+  }
+
+  size_t NumPoints(int frame) const {
+    return entries_[frame].points;
+  }
+
+  /**
+   * @return The points of a frame in the mapping, NumPoints(frame) of them
+   */
+  const pcl::PointXYZ* Points(int frame) const {
+    return reinterpret_cast<const pcl::PointXYZ*>(file_.Data() + entries_[frame].offset);
+  }
+
+  /**
+   * Copies the frame recorded at timestamp into cloud
+   * @return false if there is no such frame, cloud is left as it was
+   */
+  bool Load(long long timestamp, pcl::PointCloud<pcl::PointXYZ>& cloud) const {
+    int frame = Find(timestamp);
+    if (frame < 0)
+      return false;
+    size_t points = NumPoints(frame);
+    cloud.points.resize(points);
+    if (points > 0)
+      std::memcpy(cloud.points.data(), Points(frame), points * sizeof(pcl::PointXYZ));
+    cloud.width = points;
+    cloud.height = 1;
+    cloud.is_dense = true;
+    return true;
+  }
+
+ private:
+  MappedFile file_;
+  const PCDArchiveEntry* entries_;
+  int frames_;
+};
+
+#endif  // PCD_ARCHIVE_H_
@@ -0,0 +1,65 @@
+// Packs the highway_<timestamp>.pcd files of a directory into one archive
+// for Highway PCD playback, see pcd_archive.h.
+// Usage: pcd_pack <pcd directory> <archive>
+//   e.g. pcd_pack ../src/sensors/data/pcd ../src/sensors/data/pcd/highway.pcda
+
+#include <dirent.h>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <pcl/io/pcd_io.h>
+#include "pcd_archive.h"
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "usage: pcd_pack <pcd directory> <archive>" << std::endl;
+    return 1;
+  }
+  std::string directory = argv[1];
+  DIR* dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    std::cerr << "can not read " << directory << std::endl;
+    return 1;
+  }
+  PCDArchiveWriter archive;
+  if (!archive.Open(argv[2])) {
+    std::cerr << "can not write " << argv[2] << std::endl;
+    closedir(dir);
+    return 1;
+  }
+
+  // the same names stepHighway loads, highway_<timestamp in us>.pcd
+  const std::string prefix = "highway_", suffix = ".pcd";
+  pcl::PointCloud<pcl::PointXYZ> cloud;
+  int frames = 0;
+  size_t points = 0;
+  while (dirent* item = readdir(dir)) {
+    std::string name = item->d_name;
+    if (name.size() <= prefix.size() + suffix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+      continue;
+    std::string stamp = name.substr(prefix.size(), name.size() - prefix.size() - suffix.size());
+    char* end;
+    long long timestamp = strtoll(stamp.c_str(), &end, 10);
+    if (*end != '\0')
+      continue;
+    if (pcl::io::loadPCDFile<pcl::PointXYZ>(directory + "/" + name, cloud) == -1) {
+      std::cerr << "can not read " << name << std::endl;
+      continue;
+    }
+    if (!archive.Add(timestamp, cloud)) {
+      std::cerr << "can not write " << argv[2] << std::endl;
+      closedir(dir);
+      return 1;
+    }
+    frames++;
+    points += cloud.points.size();
+  }
+  closedir(dir);
+  if (!archive.Close()) {
+    std::cerr << "can not write " << argv[2] << std::endl;
+    return 1;
+  }
+  std::cout << "packed " << frames << " frames, " << points << " points into " << argv[2] << std::endl;
+  return 0;
+}
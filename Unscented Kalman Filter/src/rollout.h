@@ -0,0 +1,170 @@
+#ifndef ROLLOUT_H_
+#define ROLLOUT_H_
+
+#include <cmath>
+#include <vector>
+#include "Eigen/Dense"
+
+/**
+ * Predicted paths of many CTRV tracks over a fixed horizon. Only the mean is
+ * propagated, in closed form at every step time t = k * dt, so there are no
+ * sigma points and every step is independent of the previous one. Optionally
+ * a linearised position covariance is added: the initial covariance pushed
+ * through the Jacobian of the closed form plus the noise of one CTRV
+ * prediction step of length t.
+ *
+ * Inputs are kStateSize values of [px py v yaw yawd] and a column major
+ * kStateSize x kStateSize covariance per track, one track after another, so a single
+ * UKF can pass x_.data() and P_.data(). Outputs are stored step major.
+ */
+class CTRVRollout {
+ public:
+  enum { kStateSize = 5, kCovarianceSize = kStateSize * kStateSize };
+
+  CTRVRollout() : std_a_(2.0), tracks_(0), steps_(0) {}
+
+  /**
+   * @param x tracks * kStateSize state values
+   * @param P tracks * kCovarianceSize covariance values, or nullptr for the
+   *     mean only
+   * @param tracks Number of tracks
+   * @param dt Step length in s
+   * @param steps Number of steps, the path covers times dt ... steps * dt
+   */
+  void Run(const double* x, const double* P, int tracks, double dt, int steps) {
+    tracks_ = tracks;
+    steps_ = steps;
+    size_t size = (size_t)tracks * steps;
+    px_.resize(size);
+    py_.resize(size);
+    yaw_.resize(size);
+
+    // state as one array per field, so the step loop below runs over plain
+    // arrays and vectorises
+    px0_.resize(tracks);
+    py0_.resize(tracks);
+    v0_.resize(tracks);
+    yaw0_.resize(tracks);
+    yawd0_.resize(tracks);
+    for (int i = 0; i < tracks; ++i) {
+      const double* state = x + (size_t)i * kStateSize;
+      px0_[i] = state[0];
+      py0_[i] = state[1];
+      v0_[i] = state[2];
+      yaw0_[i] = state[3];
+      yawd0_[i] = state[4];
+    }
+
+    for (int k = 0; k < steps; ++k) {
+      double t = (k + 1) * dt;
+      double* px = &px_[(size_t)k * tracks];
+      double* py = &py_[(size_t)k * tracks];
+      double* yaw = &yaw_[(size_t)k * tracks];
+      for (int i = 0; i < tracks; ++i) {
+        double yaw_t = yaw0_[i] + yawd0_[i] * t;
+        // both branches are computed and one is selected, keeps the loop
+        // free of control flow
+        bool turning = fabs(yawd0_[i]) > .001;
+        double yawd = turning ? yawd0_[i] : 1.;
+        double dx_turn = v0_[i] / yawd * (sin(yaw_t) - sin(yaw0_[i]));
+        double dy_turn = v0_[i] / yawd * (cos(yaw0_[i]) - cos(yaw_t));
+        double dx_straight = v0_[i] * cos(yaw0_[i]) * t;
+        double dy_straight = v0_[i] * sin(yaw0_[i]) * t;
+        px[i] = px0_[i] + (turning ? dx_turn : dx_straight);
+        py[i] = py0_[i] + (turning ? dy_turn : dy_straight);
+        yaw[i] = yaw_t;
+      }
+    }
+
+    if (P == nullptr) {
+      var_px_.clear();
+      var_py_.clear();
+      cov_pxpy_.clear();
+      return;
+    }
+    var_px_.resize(size);
+    var_py_.resize(size);
+    cov_pxpy_.resize(size);
+    for (int i = 0; i < tracks; ++i) {
+      Eigen::Map<const Eigen::Matrix<double, kStateSize, kStateSize> > P0(P + (size_t)i * kCovarianceSize);
+      double v = v0_[i], yaw0 = yaw0_[i], yawd = yawd0_[i];
+      double s0 = sin(yaw0), c0 = cos(yaw0);
+      for (int k = 0; k < steps; ++k) {
+        double t = (k + 1) * dt;
+        // position rows of the Jacobian of the closed form path
+        Eigen::Matrix<double, 2, kStateSize> J;
+        if (fabs(yawd) > .001) {
+          double s1 = sin(yaw0 + yawd * t), c1 = cos(yaw0 + yawd * t);
+          J << 1, 0, (s1 - s0) / yawd, v / yawd * (c1 - c0), v * (t * c1 / yawd - (s1 - s0) / (yawd * yawd)),
+               0, 1, (c0 - c1) / yawd, v / yawd * (s1 - s0), v * (t * s1 / yawd - (c0 - c1) / (yawd * yawd));
+        } else {
+          J << 1, 0, c0 * t, -v * s0 * t, -0.5 * v * s0 * t * t,
+               0, 1, s0 * t, v * c0 * t, 0.5 * v * c0 * t * t;
+        }
+        Eigen::Matrix2d P_pos = J * P0 * J.transpose();
+        // longitudinal acceleration noise over t, the yaw acceleration noise
+        // does not reach the position in one CTRV step
+        double q = 0.25 * t * t * t * t * std_a_ * std_a_;
+        size_t index = (size_t)k * tracks + i;
+        var_px_[index] = P_pos(0, 0) + q * c0 * c0;
+        var_py_[index] = P_pos(1, 1) + q * s0 * s0;
+        cov_pxpy_[index] = P_pos(0, 1) + q * c0 * s0;
+      }
+    }
+  }
+
+  int Tracks() const {
+    return tracks_;
+  }
+
+  int Steps() const {
+    return steps_;
+  }
+
+  bool HasCovariance() const {
+    return !var_px_.empty();
+  }
+
+  /**
+   * Predicted position and yaw of a track after step + 1 steps
+   */
+  double Px(int track, int step) const {
+    return px_[(size_t)step * tracks_ + track];
+  }
+
+  double Py(int track, int step) const {
+    return py_[(size_t)step * tracks_ + track];
+  }
+
+  double Yaw(int track, int step) const {
+    return yaw_[(size_t)step * tracks_ + track];
+  }
+
+  /**
+   * Position covariance of a track after step + 1 steps, only after a Run
+   * with a covariance
+   */
+  Eigen::Matrix2d PositionCovariance(int track, int step) const {
+    size_t index = (size_t)step * tracks_ + track;
+    Eigen::Matrix2d P_pos;
+    P_pos << var_px_[index], cov_pxpy_[index],
+             cov_pxpy_[index], var_py_[index];
+    return P_pos;
+  }
+
+  // Process noise standard deviation longitudinal acceleration in m/s^2
+  double std_a_;
+
+ private:
+  int tracks_;
+  int steps_;
+
+  // initial state, one array per field
+  std::vector<double> px0_, py0_, v0_, yaw0_, yawd0_;
+
+  // results, steps * tracks values each
+  std::vector<double> px_, py_, yaw_;
+  std::vector<double> var_px_, var_py_, cov_pxpy_;
+};
+
+#endif  // ROLLOUT_H_
@@ -0,0 +1,258 @@
+#ifndef SCENARIO_H_
+#define SCENARIO_H_
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * Traffic for the highway, cars and their actuation schedules, loaded from a
+ * text file instead of being written into Highway. Every car field is one
+ * array indexed by car, and Step moves all cars in one loop over those
+ * arrays, so thousands of cars cost little more than a few.
+ *
+ * Motion is the kinematic model of Car::move with the same float and double
+ * mix, so a scenario steps exactly like the equivalent Car objects. The
+ * orientation quaternion Car keeps for rendering is left to the caller.
+ *
+ * File format, one statement per line, # starts a comment:
+ *   car <name> <x> <y> <velocity> <angle> [<length> <width> <height> <Lf>]
+ *   at <time in s> <acceleration> <steering>
+ * An at line schedules an actuation of the car above it, in time order.
+ */
+class TrafficScenario {
+ public:
+  TrafficScenario() : dirty_(false) {}
+
+  /**
+   * @return false if the file can not be read or has a malformed line,
+   *     error() then tells which
+   */
+  bool Load(const std::string& path) {
+    std::ifstream file(path.c_str());
+    if (!file) {
+      error_ = "can not read " + path;
+      return false;
+    }
+    return Parse(file);
+  }
+
+  bool Parse(std::istream& in) {
+    Clear();
+    std::string line;
+    for (int number = 1; std::getline(in, line); ++number) {
+      line = line.substr(0, line.find('#'));
+      std::istringstream fields(line);
+      std::string keyword;
+      if (!(fields >> keyword))
+        continue;
+      bool ok = false;
+      if (keyword == "car") {
+        std::string name;
+        double x, y;
+        float velocity, angle, length = 4, width = 2, height = 2, lf = 2;
+        ok = static_cast<bool>(fields >> name >> x >> y >> velocity >> angle);
+        if (ok && fields >> length)
+          ok = static_cast<bool>(fields >> width >> height >> lf);
+        if (ok)
+          AddCar(name, x, y, velocity, angle, length, width, height, lf);
+      } else if (keyword == "at") {
+        double time_s;
+        float acceleration, steering;
+        ok = Size() > 0 && fields >> time_s >> acceleration >> steering;
+        if (ok)
+          AddActuation(Size() - 1, std::llround(time_s * 1e6), acceleration, steering);
+      }
+      std::string rest;
+      if (!ok || fields >> rest) {
+        error_ = "line " + std::to_string(number) + ": " + line;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void Clear() {
+    name_.clear();
+    px_.clear();
+    py_.clear();
+    velocity_.clear();
+    angle_.clear();
+    acceleration_.clear();
+    steering_.clear();
+    lf_.clear();
+    length_.clear();
+    width_.clear();
+    height_.clear();
+    schedules_.clear();
+    actuations_.clear();
+    begin_.clear();
+    next_.clear();
+    end_.clear();
+    dirty_ = false;
+    error_.clear();
+  }
+
+  /**
+   * @return The car index
+   */
+  int AddCar(const std::string& name, double x, double y, float velocity, float angle, float length = 4,
+             float width = 2, float height = 2, float lf = 2) {
+    name_.push_back(name);
+    px_.push_back(x);
+    py_.push_back(y);
+    velocity_.push_back(velocity);
+    angle_.push_back(angle);
+    acceleration_.push_back(0);
+    steering_.push_back(0);
+    lf_.push_back(lf);
+    length_.push_back(length);
+    width_.push_back(width);
+    height_.push_back(height);
+    schedules_.push_back(std::vector<Actuation>());
+    begin_.push_back(0);
+    next_.push_back(0);
+    end_.push_back(0);
+    dirty_ = true;
+    return Size() - 1;
+  }
+
+  /**
+   * Schedules an actuation, times of one car must not decrease
+   */
+  void AddActuation(int car, long long time_us, float acceleration, float steering) {
+    Actuation actuation = {time_us, acceleration, steering};
+    schedules_[car].push_back(actuation);
+    dirty_ = true;
+  }
+
+  int Size() const {
+    return px_.size();
+  }
+
+  /**
+   * Moves every car by dt. Like Car::move, at most one actuation per car
+   * becomes active per step, the next one once time_us reaches its time.
+   */
+  void Step(float dt, long long time_us) {
+    if (dirty_)
+      Flatten();
+    int n = Size();
+    for (int i = 0; i < n; ++i) {
+      if (next_[i] < end_[i] && time_us >= actuations_[next_[i]].time_us) {
+        acceleration_[i] = actuations_[next_[i]].acceleration;
+        steering_[i] = actuations_[next_[i]].steering;
+        next_[i]++;
+      }
+    }
+    // one array per field and no branches, so the loop vectorizes where the
+    // compiler has vector sin and cos
+    double* px = px_.data();
+    double* py = py_.data();
+    float* velocity = velocity_.data();
+    float* angle = angle_.data();
+    const float* acceleration = acceleration_.data();
+    const float* steering = steering_.data();
+    const float* lf = lf_.data();
+    for (int i = 0; i < n; ++i) {
+      px[i] += velocity[i] * std::cos(angle[i]) * dt;
+      py[i] += velocity[i] * std::sin(angle[i]) * dt;
+      angle[i] += velocity[i] * steering[i] * dt / lf[i];
+      velocity[i] += acceleration[i] * dt;
+    }
+  }
+
+  const std::string& Name(int car) const {
+    return name_[car];
+  }
+
+  double Px(int car) const {
+    return px_[car];
+  }
+
+  double Py(int car) const {
+    return py_[car];
+  }
+
+  float Velocity(int car) const {
+    return velocity_[car];
+  }
+
+  float Angle(int car) const {
+    return angle_[car];
+  }
+
+  float Acceleration(int car) const {
+    return acceleration_[car];
+  }
+
+  float Steering(int car) const {
+    return steering_[car];
+  }
+
+  float Lf(int car) const {
+    return lf_[car];
+  }
+
+  float Length(int car) const {
+    return length_[car];
+  }
+
+  float Width(int car) const {
+    return width_[car];
+  }
+
+  float Height(int car) const {
+    return height_[car];
+  }
+
+  const std::string& error() const {
+    return error_;
+  }
+
+ private:
+  struct Actuation {
+    long long time_us;
+    float acceleration;
+    float steering;
+  };
+
+  /**
+   * Lays the schedules out in one array for Step, keeping how far each car
+   * has got through its own
+   */
+  void Flatten() {
+    actuations_.clear();
+    for (int i = 0; i < Size(); ++i) {
+      int progress = next_[i] - begin_[i];
+      begin_[i] = actuations_.size();
+      next_[i] = begin_[i] + progress;
+      actuations_.insert(actuations_.end(), schedules_[i].begin(), schedules_[i].end());
+      end_[i] = actuations_.size();
+    }
+    dirty_ = false;
+  }
+
+  std::vector<std::string> name_;
+  // position in m, double like Car::position
+  std::vector<double> px_, py_;
+  std::vector<float> velocity_, angle_, acceleration_, steering_;
+  // distance between front of vehicle and center of gravity
+  std::vector<float> lf_;
+  std::vector<float> length_, width_, height_;
+
+  // schedule of each car as added
+  std::vector<std::vector<Actuation> > schedules_;
+  // all schedules in one array, car i owns [begin_[i], end_[i]) and
+  // next_[i] is its next actuation
+  std::vector<Actuation> actuations_;
+  std::vector<int> begin_, next_, end_;
+  // set when schedules_ changed since the last Flatten
+  bool dirty_;
+
+  std::string error_;
+};
+
+#endif  // SCENARIO_H_
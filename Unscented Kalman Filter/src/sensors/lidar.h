@@ -3,6 +3,7 @@
 #include "../render/render.h"
 #include <ctime>
 #include <chrono>
+#include "rng.h"
 
 const double pi = 3.1415;
 
@@ -27,7 +28,9 @@ struct Ray
 		  castPosition(origin), castDistance(0)
 	{}
 
-	void rayCast(const std::vector<Car>& cars, double minDistance, double maxDistance, pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud, double slopeAngle, double sderr)
+	// noiseSeed, scanIndex and rayIndex key the point noise, so a scan is reproducible
+	void rayCast(const std::vector<Car>& cars, double minDistance, double maxDistance, pcl::PointCloud<pcl::PointXYZ>::Ptr& cloud, double slopeAngle, double sderr,
+				 uint64_t noiseSeed, uint64_t scanIndex, uint64_t rayIndex)
 	{
 		// reset ray
 		castPosition = origin;
@@ -47,7 +50,7 @@ struct Ray
 			// check if there is any collisions with cars
 			if(!collision && castDistance < maxDistance)
 			{
-				for(Car car : cars)
+				for(const Car& car : cars)
 				{
 					collision |= car.checkCollision(castPosition);
 					if(collision)
@@ -59,9 +62,10 @@ struct Ray
 		if((castDistance >= minDistance)&&(castDistance<=maxDistance)&& (castPosition.y <= 6 && castPosition.y >= -6 && castPosition.x <= 50 && castPosition.x >= -15))
 		{
 			// add noise based on standard deviation error
-			double rx = ((double) rand() / (RAND_MAX));
-			double ry = ((double) rand() / (RAND_MAX));
-			double rz = ((double) rand() / (RAND_MAX));
+			Philox4x32 noise(noiseSeed, scanIndex, rayIndex);
+			double rx = noise.uniform(0);
+			double ry = noise.uniform(1);
+			double rz = noise.uniform(2);
 			cloud->points.push_back(pcl::PointXYZ(castPosition.x+rx*sderr, castPosition.y+ry*sderr, castPosition.z+rz*sderr));
 		}
 			
@@ -81,8 +85,11 @@ struct Lidar
 	double maxDistance;
 	double resoultion;
 	double sderr;
+	// key of the point noise, scanCount moves on with every scan()
+	uint64_t noiseSeed;
+	uint64_t scanCount;
 
-	Lidar(std::vector<Car> setCars, double setGroundSlope)
+	Lidar(const std::vector<Car>& setCars, double setGroundSlope)
 		: cloud(new pcl::PointCloud<pcl::PointXYZ>()), position(0,0,3.0)
 	{
 		// TODO:: set minDistance to 5 to remove points from roof of ego car
@@ -93,6 +100,8 @@ struct Lidar
 		sderr = 0.02;
 		cars = setCars;
 		groundSlope = setGroundSlope;
+		noiseSeed = 0;
+		scanCount = 0;
 
 		// TODO:: increase number of layers to 8 to get higher resoultion pcd
 		int numLayers = 64;
@@ -119,7 +128,7 @@ struct Lidar
 		// pcl uses boost smart pointers for cloud pointer so we don't have to worry about manually freeing the memory
 	}
 
-	void updateCars(std::vector<Car> setCars)
+	void updateCars(const std::vector<Car>& setCars)
 	{
 		cars = setCars;
 	}
@@ -129,8 +138,12 @@ struct Lidar
  
 		cloud->points.clear();
 		auto startTime = std::chrono::steady_clock::now();
-		for(Ray ray : rays)
-			ray.rayCast(cars, minDistance, maxDistance, cloud, groundSlope, sderr);
+		for(size_t i = 0; i < rays.size(); i++)
+		{
+			Ray ray = rays[i];
+			ray.rayCast(cars, minDistance, maxDistance, cloud, groundSlope, sderr, noiseSeed, scanCount, i);
+		}
+		scanCount++;
 		auto endTime = std::chrono::steady_clock::now();
 		auto elapsedTime = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
 		cout << "ray casting took " << elapsedTime.count() << " milliseconds" << endl;
@@ -0,0 +1,90 @@
+#ifndef RNG_H
+#define RNG_H
+// Counter based random numbers, Philox4x32-10 from Salmon et al.,
+// "Parallel random numbers: as easy as 1, 2, 3" (SC 2011).
+// A block of four 32 bit words is a pure function of a 64 bit key and a
+// 128 bit counter, so there is no generator state to seed, share or lock:
+// the same (seed, timestamp, stream) always gives the same noise, from any
+// thread and in any order.
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+
+struct Philox4x32
+{
+	uint32_t v[4];
+
+	Philox4x32(uint64_t key, uint64_t counterHi, uint64_t counterLo)
+	{
+		uint32_t k0 = (uint32_t)key, k1 = (uint32_t)(key >> 32);
+		v[0] = (uint32_t)counterLo;
+		v[1] = (uint32_t)(counterLo >> 32);
+		v[2] = (uint32_t)counterHi;
+		v[3] = (uint32_t)(counterHi >> 32);
+		for(int round = 0; round < 10; round++)
+		{
+			uint64_t p0 = (uint64_t)0xD2511F53 * v[0];
+			uint64_t p1 = (uint64_t)0xCD9E8D57 * v[2];
+			uint32_t x0 = (uint32_t)(p1 >> 32) ^ v[1] ^ k0;
+			uint32_t x2 = (uint32_t)(p0 >> 32) ^ v[3] ^ k1;
+			v[0] = x0;
+			v[1] = (uint32_t)p1;
+			v[2] = x2;
+			v[3] = (uint32_t)p0;
+			k0 += 0x9E3779B9;
+			k1 += 0xBB67AE85;
+		}
+	}
+
+	// word i mapped to (0, 1), never exactly 0 or 1
+	double uniform(int i) const
+	{
+		return (v[i] + 0.5) * (1.0 / 4294967296.0);
+	}
+
+	// four standard normal samples, Box-Muller on the two word pairs
+	void normals(double out[4]) const
+	{
+		for(int i = 0; i < 4; i += 2)
+		{
+			double r = sqrt(-2.0 * log(uniform(i)));
+			double theta = 2.0 * M_PI * uniform(i + 1);
+			out[i] = r * cos(theta);
+			out[i + 1] = r * sin(theta);
+		}
+	}
+};
+
+// one standard normal sample for (seed, timestamp, stream)
+inline double normalNoise(uint64_t seed, long long timestamp, uint32_t stream)
+{
+	Philox4x32 block(seed, stream, (uint64_t)timestamp);
+	double r = sqrt(-2.0 * log(block.uniform(0)));
+	return r * cos(2.0 * M_PI * block.uniform(1));
+}
+
+// n standard normal samples from counters first, first+1, ... of a stream.
+// The uniforms are produced first and Box-Muller runs as a separate loop over
+// plain arrays, so the compiler can vectorise it
+inline void normalNoise(uint64_t seed, uint64_t first, uint32_t stream, size_t n, double* out)
+{
+	const size_t block = 256;
+	double u1[block], u2[block];
+	for(size_t begin = 0; begin < n; begin += block)
+	{
+		size_t count = n - begin < block ? n - begin : block;
+		for(size_t i = 0; i < count; i += 2)
+		{
+			Philox4x32 words(seed, stream, first + (begin + i) / 2);
+			u1[i] = words.uniform(0);
+			u2[i] = words.uniform(1);
+			u1[i + 1] = words.uniform(2);
+			u2[i + 1] = words.uniform(3);
+		}
+		for(size_t i = 0; i < count; i++)
+			out[begin + i] = sqrt(-2.0 * log(u1[i])) * cos(2.0 * M_PI * u2[i]);
+	}
+}
+
+#endif
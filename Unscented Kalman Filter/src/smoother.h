@@ -0,0 +1,224 @@
+#ifndef SMOOTHER_H_
+#define SMOOTHER_H_
+
+#include <algorithm>
+#include <vector>
+#include "Eigen/Dense"
+#include "thread_pool.h"
+#include "ukf.h"
+
+/**
+ * Unscented Rauch-Tung-Striebel smoother for many tracks, for offline use
+ * on recorded drives where every measurement of a track is known up front.
+ *
+ * The forward pass is a normal UKF with store_prediction_ set. After each
+ * predict and update Record keeps the filtered mean and covariance and the
+ * prediction's mean, covariance and cross covariance in one flat buffer per
+ * track, symmetric matrices packed to their upper triangle. Smooth then runs
+ * the backward pass of every track, tracks spread over a thread pool:
+ *
+ *   G_k = C_k+1 P_k+1|k^-1
+ *   x_k|N = x_k|k + G_k (x_k+1|N - x_k+1|k)
+ *   P_k|N = P_k|k + G_k (P_k+1|N - P_k+1|k) G_k'
+ *
+ * In fixed-lag mode every step only uses the measurements of the next lag
+ * steps, like an online smoother that reports with a delay of lag steps.
+ */
+class URTSSmoother {
+ public:
+  enum {
+    kStateSize = 5,
+    kPackedSize = kStateSize * (kStateSize + 1) / 2,
+    // filtered x and P, predicted x and P, cross covariance C
+    kStepSize = 2 * (kStateSize + kPackedSize) + kStateSize * kStateSize,
+    kSmoothedSize = kStateSize + kPackedSize
+  };
+
+  typedef Eigen::Matrix<double, kStateSize, 1> StateVector;
+  typedef Eigen::Matrix<double, kStateSize, kStateSize> StateMatrix;
+
+  /**
+   * @param num_threads Threads used by Smooth, 0 uses all cores
+   */
+  explicit URTSSmoother(int num_threads = 0) : pool_(num_threads) {}
+
+  /**
+   * @return The track index
+   */
+  int AddTrack() {
+    tracks_.push_back(Track());
+    return tracks_.size() - 1;
+  }
+
+  int Size() const {
+    return tracks_.size();
+  }
+
+  int NumThreads() const {
+    return pool_.Size();
+  }
+
+  int Steps(int track) const {
+    return tracks_[track].timestamps.size();
+  }
+
+  void Clear() {
+    tracks_.clear();
+  }
+
+  /**
+   * Stores the forward statistics of a track after a ProcessMeasurement or
+   * a ProcessMeasurements call with measurements of one timestamp, so one
+   * prediction per step. ukf.store_prediction_ must be set. The first step
+   * of a track is the initialization and has no prediction.
+   */
+  void Record(int track, const UKF& ukf) {
+    Track& t = tracks_[track];
+    bool first = t.timestamps.empty();
+    t.timestamps.push_back(ukf.time_us_);
+    t.forward.resize(t.forward.size() + kStepSize, 0.0);
+    double* step = &t.forward[t.forward.size() - kStepSize];
+    std::copy(ukf.x_.data(), ukf.x_.data() + kStateSize, step);
+    PackSymmetric(ukf.P_, step + kStateSize);
+    if (first)
+      return;
+    double* pred = step + kStateSize + kPackedSize;
+    std::copy(ukf.x_pred_.data(), ukf.x_pred_.data() + kStateSize, pred);
+    PackSymmetric(ukf.P_pred_, pred + kStateSize);
+    std::copy(ukf.C_pred_.data(), ukf.C_pred_.data() + kStateSize * kStateSize, pred + kStateSize + kPackedSize);
+  }
+
+  /**
+   * Runs the backward pass of every track
+   * @param lag Future steps each smoothed step uses, negative for the whole
+   *     track
+   */
+  void Smooth(int lag = -1) {
+    size_t grain = std::max<size_t>(1, tracks_.size() / (8 * pool_.Size()));
+    pool_.ParallelFor(tracks_.size(), grain, [this, lag](size_t begin, size_t end) {
+      for (size_t track = begin; track < end; ++track)
+        SmoothTrack(tracks_[track], lag);
+    });
+  }
+
+  long long Timestamp(int track, int step) const {
+    return tracks_[track].timestamps[step];
+  }
+
+  StateVector FilteredState(int track, int step) const {
+    return Eigen::Map<const StateVector>(&tracks_[track].forward[(size_t)step * kStepSize]);
+  }
+
+  /**
+   * Results of the latest Smooth
+   */
+  StateVector SmoothedState(int track, int step) const {
+    return Eigen::Map<const StateVector>(&tracks_[track].smoothed[(size_t)step * kSmoothedSize]);
+  }
+
+  StateMatrix SmoothedCovariance(int track, int step) const {
+    return UnpackSymmetric(&tracks_[track].smoothed[(size_t)step * kSmoothedSize + kStateSize]);
+  }
+
+ private:
+  struct Track {
+    std::vector<long long> timestamps;
+    // kStepSize values per step
+    std::vector<double> forward;
+    // kSmoothedSize values per step
+    std::vector<double> smoothed;
+    // smoother gain per step, scratch of Smooth
+    std::vector<double> gains;
+  };
+
+  static void PackSymmetric(const Eigen::MatrixXd& P, double* packed) {
+    for (int col = 0; col < kStateSize; ++col)
+      for (int row = 0; row <= col; ++row)
+        *packed++ = P(row, col);
+  }
+
+  static StateMatrix UnpackSymmetric(const double* packed) {
+    StateMatrix P;
+    for (int col = 0; col < kStateSize; ++col)
+      for (int row = 0; row <= col; ++row)
+        P(row, col) = P(col, row) = *packed++;
+    return P;
+  }
+
+  /**
+   * One backward step from k + 1 to k
+   * @param step The forward statistics of step k
+   * @param next The forward statistics of step k + 1
+   * @param G The smoother gain of step k
+   */
+  static void Backward(const double* step, const double* next, const StateMatrix& G, StateVector& x, StateMatrix& P) {
+    const double* pred = next + kStateSize + kPackedSize;
+    Eigen::Map<const StateVector> x_filtered(step);
+    Eigen::Map<const StateVector> x_pred(pred);
+    StateVector x_diff = x - x_pred;
+    x_diff(3) = NormalizeAngle(x_diff(3));
+    x = x_filtered + G * x_diff;
+    x(3) = NormalizeAngle(x(3));
+    P = UnpackSymmetric(step + kStateSize) + G * (P - UnpackSymmetric(pred + kStateSize)) * G.transpose();
+  }
+
+  static double NormalizeAngle(double angle) {
+    while (angle > M_PI)
+      angle -= 2. * M_PI;
+    while (angle < -M_PI)
+      angle += 2. * M_PI;
+    return angle;
+  }
+
+  static Eigen::Map<const StateMatrix> Gain(const Track& track, int k) {
+    return Eigen::Map<const StateMatrix>(&track.gains[(size_t)k * kStateSize * kStateSize]);
+  }
+
+  static void Store(const StateVector& x, const StateMatrix& P, double* smoothed) {
+    std::copy(x.data(), x.data() + kStateSize, smoothed);
+    PackSymmetric(P, smoothed + kStateSize);
+  }
+
+  static void SmoothTrack(Track& track, int lag) {
+    int steps = track.timestamps.size();
+    track.smoothed.resize((size_t)steps * kSmoothedSize);
+    if (steps == 0)
+      return;
+    const double* forward = track.forward.data();
+    // the gains only depend on the forward pass, every window below shares them
+    track.gains.resize((size_t)steps * kStateSize * kStateSize);
+    for (int k = 0; k + 1 < steps; ++k) {
+      const double* pred = forward + (size_t)(k + 1) * kStepSize + kStateSize + kPackedSize;
+      Eigen::Map<const StateMatrix> C(pred + kStateSize + kPackedSize);
+      Eigen::Map<StateMatrix> G(&track.gains[(size_t)k * kStateSize * kStateSize]);
+      G = UnpackSymmetric(pred + kStateSize).ldlt().solve(C.transpose()).transpose();
+    }
+    StateVector x;
+    StateMatrix P;
+    if (lag < 0 || lag >= steps - 1) {
+      // full batch, one pass from the last step back
+      x = Eigen::Map<const StateVector>(forward + (size_t)(steps - 1) * kStepSize);
+      P = UnpackSymmetric(forward + (size_t)(steps - 1) * kStepSize + kStateSize);
+      Store(x, P, &track.smoothed[(size_t)(steps - 1) * kSmoothedSize]);
+      for (int k = steps - 2; k >= 0; --k) {
+        Backward(forward + (size_t)k * kStepSize, forward + (size_t)(k + 1) * kStepSize, Gain(track, k), x, P);
+        Store(x, P, &track.smoothed[(size_t)k * kSmoothedSize]);
+      }
+      return;
+    }
+    // fixed lag, a short pass back from k + lag for every step k
+    for (int k = 0; k < steps; ++k) {
+      int last = std::min(k + lag, steps - 1);
+      x = Eigen::Map<const StateVector>(forward + (size_t)last * kStepSize);
+      P = UnpackSymmetric(forward + (size_t)last * kStepSize + kStateSize);
+      for (int j = last - 1; j >= k; --j)
+        Backward(forward + (size_t)j * kStepSize, forward + (size_t)(j + 1) * kStepSize, Gain(track, j), x, P);
+      Store(x, P, &track.smoothed[(size_t)k * kSmoothedSize]);
+    }
+  }
+
+  std::vector<Track> tracks_;
+  ThreadPool pool_;
+};
+
+#endif  // SMOOTHER_H_
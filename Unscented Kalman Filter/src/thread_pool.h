@@ -0,0 +1,118 @@
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads that stay alive between jobs, so handing out a
+ * batch costs a wake up instead of a thread start. One job runs at a time;
+ * ParallelFor must not be called from several threads at once.
+ */
+class ThreadPool {
+ public:
+  /**
+   * @param num_threads Total threads including the caller, 0 uses all cores
+   */
+  explicit ThreadPool(int num_threads = 0)
+      : generation_(0), pending_(0), stop_(false) {
+    if (num_threads <= 0)
+      num_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < num_threads; ++i)
+      workers_.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    start_cv_.notify_all();
+    for (std::thread& worker : workers_)
+      worker.join();
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  int Size() const {
+    return workers_.size() + 1;
+  }
+
+  /**
+   * Runs func(begin, end) over [0, count) in chunks of grain items. Chunks are
+   * handed out on demand, the calling thread works too and the call returns
+   * when every chunk is done.
+   */
+  template <typename Func>
+  void ParallelFor(size_t count, size_t grain, Func func) {
+    if (count == 0)
+      return;
+    grain = std::max<size_t>(1, grain);
+
+    std::atomic<size_t> next(0);
+    auto run = [&]() {
+      for (;;) {
+        size_t begin = next.fetch_add(grain);
+        if (begin >= count)
+          break;
+        func(begin, std::min(count, begin + grain));
+      }
+    };
+
+    if (workers_.empty() || count <= grain) {
+      run();
+      return;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job_ = run;
+      pending_ = workers_.size();
+      ++generation_;
+    }
+    start_cv_.notify_all();
+    run();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return pending_ == 0; });
+    job_ = nullptr;
+  }
+
+ private:
+  void WorkerLoop() {
+    int seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        start_cv_.wait(lock, [&] { return stop_ || generation_ != seen; });
+        if (stop_)
+          return;
+        seen = generation_;
+      }
+      // job_ stays put until every worker has checked in below
+      job_();
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--pending_ == 0)
+          done_cv_.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable start_cv_;
+  std::condition_variable done_cv_;
+  std::function<void()> job_;
+  int generation_;
+  int pending_;
+  bool stop_;
+};
+
+#endif  // THREAD_POOL_H_
@@ -1,6 +1,6 @@
 #include <iostream>
-#include <random>
 #include "tools.h"
+#include "sensors/rng.h"
 
 using namespace std;
 using std::vector;
@@ -9,40 +9,44 @@ Tools::Tools() {}
 
 Tools::~Tools() {}
 
-double Tools::noise(double stddev, long long seedNum)
+double Tools::noise(double stddev, long long timestamp, int track, int component)
 {
-	mt19937::result_type seed = seedNum;
-	auto dist = std::bind(std::normal_distribution<double>{0, stddev}, std::mt19937(seed));
-	return dist();
+	// counter based, no generator to build per sample and safe to call from any thread
+	return stddev * normalNoise(noiseSeed, timestamp, 5 * track + component);
 }
 
 // sense where a car is located using lidar measurement
-lmarker Tools::lidarSense(Car& car, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize)
+lmarker Tools::lidarSense(Car& car, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize, std::vector<MeasurementPackage>* batch)
 {
 	MeasurementPackage meas_package;
 	meas_package.sensor_type_ = MeasurementPackage::LASER;
   	meas_package.raw_measurements_ = VectorXd(2);
 
-	lmarker marker = lmarker(car.position.x + noise(0.15,timestamp), car.position.y + noise(0.15,timestamp+1));
+	lmarker marker = lmarker(car.position.x + noise(0.15,timestamp,trackIndex,0), car.position.y + noise(0.15,timestamp,trackIndex,1));
 	if(visualize)
 		viewer->addSphere(pcl::PointXYZ(marker.x,marker.y,3.0),0.5, 1, 0, 0,car.name+"_lmarker");
 
     meas_package.raw_measurements_ << marker.x, marker.y;
     meas_package.timestamp_ = timestamp;
 
-    car.ukf.ProcessMeasurement(meas_package);
+    if(recorder)
+        recorder->Write(meas_package, trackIndex);
+    if(batch)
+        batch->push_back(meas_package);
+    else
+        car.ukf.ProcessMeasurement(meas_package);
 
     return marker;
 }
 
 // sense where a car is located using radar measurement
-rmarker Tools::radarSense(Car& car, Car ego, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize)
+rmarker Tools::radarSense(Car& car, const Car& ego, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize, std::vector<MeasurementPackage>* batch)
 {
 	double rho = sqrt((car.position.x-ego.position.x)*(car.position.x-ego.position.x)+(car.position.y-ego.position.y)*(car.position.y-ego.position.y));
 	double phi = atan2(car.position.y-ego.position.y,car.position.x-ego.position.x);
 	double rho_dot = (car.velocity*cos(car.angle)*rho*cos(phi) + car.velocity*sin(car.angle)*rho*sin(phi))/rho;
 
-	rmarker marker = rmarker(rho+noise(0.3,timestamp+2), phi+noise(0.03,timestamp+3), rho_dot+noise(0.3,timestamp+4));
+	rmarker marker = rmarker(rho+noise(0.3,timestamp,trackIndex,2), phi+noise(0.03,timestamp,trackIndex,3), rho_dot+noise(0.3,timestamp,trackIndex,4));
 	if(visualize)
 	{
 		viewer->addLine(pcl::PointXYZ(ego.position.x, ego.position.y, 3.0), pcl::PointXYZ(ego.position.x+marker.rho*cos(marker.phi), ego.position.y+marker.rho*sin(marker.phi), 3.0), 1, 0, 1, car.name+"_rho");
@@ -55,7 +59,12 @@ rmarker Tools::radarSense(Car& car, Car ego, pcl::visualization::PCLVisualizer::
     meas_package.raw_measurements_ << marker.rho, marker.phi, marker.rho_dot;
     meas_package.timestamp_ = timestamp;
 
-    car.ukf.ProcessMeasurement(meas_package);
+    if(recorder)
+        recorder->Write(meas_package, trackIndex);
+    if(batch)
+        batch->push_back(meas_package);
+    else
+        car.ukf.ProcessMeasurement(meas_package);
 
     return marker;
 }
@@ -63,23 +72,22 @@ rmarker Tools::radarSense(Car& car, Car ego, pcl::visualization::PCLVisualizer::
 // Show UKF tracking and also allow showing predicted future path
 // double time:: time ahead in the future to predict
 // int steps:: how many steps to show between present and time and future time
-void Tools::ukfResults(Car car, pcl::visualization::PCLVisualizer::Ptr& viewer, double time, int steps)
+void Tools::ukfResults(const Car& car, pcl::visualization::PCLVisualizer::Ptr& viewer, double time, int steps)
 {
-	UKF ukf = car.ukf;
+	const UKF& ukf = car.ukf;
 	viewer->addSphere(pcl::PointXYZ(ukf.x_[0],ukf.x_[1],3.5), 0.5, 0, 1, 0,car.name+"_ukf");
 	viewer->addArrow(pcl::PointXYZ(ukf.x_[0], ukf.x_[1],3.5), pcl::PointXYZ(ukf.x_[0]+ukf.x_[2]*cos(ukf.x_[3]),ukf.x_[1]+ukf.x_[2]*sin(ukf.x_[3]),3.5), 0, 1, 0, car.name+"_ukf_vel");
-	if(time > 0)
+	if(time > 0 && steps > 0)
 	{
+		// only the mean path is drawn, no need to run the full UKF prediction on a copy
 		double dt = time/steps;
-		double ct = dt;
-		while(ct <= time)
+		rollout.std_a_ = ukf.std_a_;
+		rollout.Run(ukf.x_.data(), nullptr, 1, dt, steps);
+		for(int step = 0; step < steps; step++)
 		{
-			ukf.Prediction(dt);
-			viewer->addSphere(pcl::PointXYZ(ukf.x_[0],ukf.x_[1],3.5), 0.5, 0, 1, 0,car.name+"_ukf"+std::to_string(ct));
+			double ct = (step+1)*dt;
+			viewer->addSphere(pcl::PointXYZ(rollout.Px(0,step),rollout.Py(0,step),3.5), 0.5, 0, 1, 0,car.name+"_ukf"+std::to_string(ct));
 			viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_OPACITY, 1.0-0.8*(ct/time), car.name+"_ukf"+std::to_string(ct));
-			//viewer->addArrow(pcl::PointXYZ(ukf.x_[0], ukf.x_[1],3.5), pcl::PointXYZ(ukf.x_[0]+ukf.x_[2]*cos(ukf.x_[3]),ukf.x_[1]+ukf.x_[2]*sin(ukf.x_[3]),3.5), 0, 1, 0, car.name+"_ukf_vel"+std::to_string(ct));
-			//viewer->setShapeRenderingProperties(pcl::visualization::PCL_VISUALIZER_OPACITY, 1.0-0.8*(ct/time), car.name+"_ukf_vel"+std::to_string(ct));
-			ct += dt;
 		}
 	}
 
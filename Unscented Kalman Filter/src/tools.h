@@ -3,6 +3,9 @@
 #include <vector>
 #include "Eigen/Dense"
 #include "render/render.h"
+#include "accumulators.h"
+#include "rollout.h"
+#include "measurement_log.h"
 #include <pcl/io/pcd_io.h>
 
 using Eigen::MatrixXd;
@@ -40,13 +43,31 @@ class Tools {
 	virtual ~Tools();
 	
 	// Members
+	// running metrics of the current run, see stepHighway
+	RMSEAccumulator rmse = RMSEAccumulator(4);
+	NISAccumulator lidarNIS = NISAccumulator(2);
+	NISAccumulator radarNIS = NISAccumulator(3);
+	// estimations and ground_truth are only filled when keepHistory is set, e.g. for exporting a run
+	bool keepHistory = false;
+	// predicted paths drawn by ukfResults, buffers reused between frames
+	CTRVRollout rollout;
 	std::vector<VectorXd> estimations;
 	std::vector<VectorXd> ground_truth;
+	// when set every sensed measurement is logged, tagged with trackIndex, e.g. to replay the run with ukf_replay
+	MeasurementLogWriter* recorder = nullptr;
+	// index of the car being sensed, every car gets its own noise
+	int trackIndex = -1;
+	// mixed into every noise sample, runs with different seeds see different sensor noise
+	long long noiseSeed = 0;
 	
-	double noise(double stddev, long long seedNum);
-	lmarker lidarSense(Car& car, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize);
-	rmarker radarSense(Car& car, Car ego, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize);
-	void ukfResults(Car car, pcl::visualization::PCLVisualizer::Ptr& viewer, double time, int steps);
+	// normal noise, reproducible for the same (noiseSeed, timestamp, track, component),
+	// component 0-1 are the lidar and 2-4 the radar values
+	double noise(double stddev, long long timestamp, int track, int component);
+	// when batch is given the measurement is appended to it instead of going to car.ukf, so
+	// measurements of one frame can be fused with UKF::ProcessMeasurements
+	lmarker lidarSense(Car& car, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize, std::vector<MeasurementPackage>* batch = nullptr);
+	rmarker radarSense(Car& car, const Car& ego, pcl::visualization::PCLVisualizer::Ptr& viewer, long long timestamp, bool visualize, std::vector<MeasurementPackage>* batch = nullptr);
+	void ukfResults(const Car& car, pcl::visualization::PCLVisualizer::Ptr& viewer, double time, int steps);
 	/**
 	* A helper method to calculate RMSE.
 	*/
@@ -4,6 +4,128 @@
 using Eigen::MatrixXd;
 using Eigen::VectorXd;
 
+/**
+ * Wraps the listed components of v into [-pi, pi]
+ */
+static void NormalizeAngles(VectorXd& v, const std::vector<int>& angle_indices) {
+  for (int index : angle_indices) {
+    while (v(index) > M_PI)
+      v(index) -= 2. * M_PI;
+    while (v(index) < -M_PI)
+      v(index) += 2. * M_PI;
+  }
+}
+
+/**
+ * Wraps the listed rows of m into [-pi, pi]
+ */
+static void NormalizeAngleRows(MatrixXd& m, const std::vector<int>& angle_rows) {
+  for (int row : angle_rows) {
+    for (int i = 0; i < m.cols(); i++) {
+      while (m(row, i) > M_PI)
+        m(row, i) -= 2. * M_PI;
+      while (m(row, i) < -M_PI)
+        m(row, i) += 2. * M_PI;
+    }
+  }
+}
+
+/**
+ * Rank-1 update of a lower Cholesky factor in place, L L' becomes
+ * L L' + sign v v'. v is overwritten.
+ * @return false if a downdate would make the matrix indefinite, the leading
+ * columns of L are already updated then and the caller has to restore L
+ */
+static bool CholeskyRankOne(MatrixXd& L, VectorXd& v, double sign) {
+  int n = L.rows();
+  for (int k = 0; k < n; k++) {
+    double r2 = L(k, k)*L(k, k) + sign*v(k)*v(k);
+    if (r2 <= 0)
+      return false;
+    double r = sqrt(r2);
+    double c = r / L(k, k);
+    double s = v(k) / L(k, k);
+    L(k, k) = r;
+    for (int i = k + 1; i < n; i++) {
+      L(i, k) = (L(i, k) + sign*s*v(i)) / c;
+      v(i) = c*v(i) - s*L(i, k);
+    }
+  }
+  return true;
+}
+
+/**
+ * Lower Cholesky factor R' of A' A from the QR of A, with the sign of each
+ * column flipped so the diagonal is positive
+ */
+static MatrixXd FactorFromQR(const Eigen::HouseholderQR<MatrixXd>& qr, int n) {
+  MatrixXd L = qr.matrixQR().topRows(n).triangularView<Eigen::Upper>().transpose();
+  for (int k = 0; k < n; k++) {
+    if (L(k, k) < 0)
+      L.col(k) = -L.col(k);
+  }
+  return L;
+}
+
+/**
+ * Lower Cholesky factor of sum_i w_i (X_i - mean)(X_i - mean)' + N N', from
+ * a QR of the weighted deviations of sigma points 1..2n and the noise factor
+ * N, then a rank-1 update or downdate for sigma point 0, whose weight is
+ * negative for small lambda
+ * @return false if the downdate for sigma point 0 failed. L is the factor
+ * without it then, which slightly overstates the covariance but stays usable
+ */
+static bool SqrtCovariance(const MatrixXd& sigma, const VectorXd& mean, const VectorXd& weights,
+                           const MatrixXd& noise_sqrt, const std::vector<int>& angle_indices, MatrixXd& L) {
+  int n = mean.size();
+  int n_noise = noise_sqrt.cols();
+  MatrixXd A(sigma.cols() - 1 + n_noise, n);
+  for (int i = 1; i < sigma.cols(); i++) {
+    VectorXd diff = sigma.col(i) - mean;
+    NormalizeAngles(diff, angle_indices);
+    A.row(i - 1) = sqrt(weights(i)) * diff.transpose();
+  }
+  if (n_noise > 0)
+    A.bottomRows(n_noise) = noise_sqrt.transpose();
+
+  // A = Q R gives A' A = R' R, so R' is a Cholesky factor once its diagonal is positive
+  Eigen::HouseholderQR<MatrixXd> qr(A);
+  L = FactorFromQR(qr, n);
+
+  VectorXd diff = sigma.col(0) - mean;
+  NormalizeAngles(diff, angle_indices);
+  diff *= sqrt(fabs(weights(0)));
+  if (!CholeskyRankOne(L, diff, weights(0) < 0 ? -1 : 1)) {
+    L = FactorFromQR(qr, n);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * L L' becomes L L' - U U', one rank-1 downdate per column of U
+ * @param P L L' before the downdate, refactored if rounding pushes a
+ * downdate past zero
+ * @return false if P - U U' is not positive definite either. L is the factor
+ * of P then, i.e. the covariance keeps its value from before the update
+ */
+static bool CholeskyDowndate(MatrixXd& L, const MatrixXd& P, const MatrixXd& U) {
+  VectorXd v(L.rows());
+  for (int i = 0; i < U.cols(); i++) {
+    v = U.col(i);
+    if (!CholeskyRankOne(L, v, -1)) {
+      Eigen::LLT<MatrixXd> llt(P - U * U.transpose());
+      if (llt.info() == Eigen::Success) {
+        L = llt.matrixL();
+        return true;
+      }
+      L = P.llt().matrixL();
+      return false;
+    }
+  }
+  return true;
+}
+
 /**
  * Initializes Unscented Kalman filter
  */
@@ -12,7 +134,17 @@ UKF::UKF() {
   use_laser_ = true;
 
   // if this is false, radar measurements will be ignored (except during init)
-  use_radar_ = false;
+  use_radar_ = true;
+
+  // if this is true, the Cholesky factor of P_ is propagated instead of P_
+  use_sqrt_ = false;
+
+  // P_sqrt_ is factored from P_ on the first square-root step
+  P_sqrt_valid_ = false;
+  sqrt_failures_ = 0;
+
+  // if this is true, Prediction keeps its statistics for a smoother
+  store_prediction_ = false;
 
   // initial state vector
   x_ = VectorXd(5);
@@ -77,6 +209,15 @@ UKF::UKF() {
 
 UKF::~UKF() {}
 
+bool UKF::SensorEnabled(const MeasurementPackage& meas_package) const {
+  return meas_package.sensor_type_ == MeasurementPackage::RADAR ? use_radar_ : use_laser_;
+}
+
+void UKF::SetCovariance(const MatrixXd& P) {
+  P_ = P;
+  P_sqrt_valid_ = false;
+}
+
 void UKF::ProcessMeasurement(MeasurementPackage meas_package) {
   /**
    * TODO: Complete this function! Make sure you switch between lidar and radar
@@ -90,18 +231,16 @@ void UKF::ProcessMeasurement(MeasurementPackage meas_package) {
       double rhodot = meas_package.raw_measurements_(2);
       double x = rho * cos(phi);
       double y = rho * sin(phi);
-      double vx = rhodot * cos(phi);
-      double vy = rhodot * sin(phi);
-      double v = sqrt(vx * vx + vy * vy);
-      x_ << x, y, v, rho, rhodot;
+      // the range rate is the best guess of the speed, moving along the bearing
+      x_ << x, y, rhodot, phi, 0;
       
       //state covariance matrix
       //***** values can be tuned *****
       P_ << std_radr_*std_radr_, 0, 0, 0, 0,
             0, std_radr_*std_radr_, 0, 0, 0,
             0, 0, std_radrd_*std_radrd_, 0, 0,
-            0, 0, 0, std_radphi_, 0,
-            0, 0, 0, 0, std_radphi_;
+            0, 0, 0, 1, 0,
+            0, 0, 0, 0, 1;
     }
     else if (meas_package.sensor_type_ == MeasurementPackage::LASER) {
       // Initialize state.
@@ -118,12 +257,17 @@ void UKF::ProcessMeasurement(MeasurementPackage meas_package) {
     }
     
     // done initializing, no need to predict or update
+    P_sqrt_valid_ = false;
     is_initialized_ = true;
     time_us_ = meas_package.timestamp_;
     return;
        
   }
   
+  // measurements of a disabled sensor are ignored
+  if (!SensorEnabled(meas_package))
+    return;
+
   // Calculate delta_t, store current time for future
   double delta_t = (meas_package.timestamp_ - time_us_) / 1000000.0;
 
@@ -140,37 +284,59 @@ void UKF::ProcessMeasurement(MeasurementPackage meas_package) {
   }
 }
 
+void UKF::ProcessMeasurements(const std::vector<MeasurementPackage>& meas_packages) {
+  // the first measurement only initializes, nothing to share with the rest
+  if (!is_initialized_) {
+    for (const MeasurementPackage& meas_package : meas_packages)
+      ProcessMeasurement(meas_package);
+    return;
+  }
+
+  // disabled sensors are left out of the stack, the packages are only
+  // copied when there is one to leave out
+  bool all_enabled = true;
+  for (const MeasurementPackage& meas_package : meas_packages)
+    all_enabled &= SensorEnabled(meas_package);
+  std::vector<MeasurementPackage> filtered;
+  if (!all_enabled) {
+    for (const MeasurementPackage& meas_package : meas_packages) {
+      if (SensorEnabled(meas_package))
+        filtered.push_back(meas_package);
+    }
+  }
+  const std::vector<MeasurementPackage>& enabled = all_enabled ? meas_packages : filtered;
+  if (enabled.empty())
+    return;
+
+  bool same_time = true;
+  for (const MeasurementPackage& meas_package : enabled)
+    same_time &= meas_package.timestamp_ == enabled[0].timestamp_;
+
+  if (!same_time || enabled.size() == 1) {
+    for (const MeasurementPackage& meas_package : enabled)
+      ProcessMeasurement(meas_package);
+    return;
+  }
+
+  double delta_t = (enabled[0].timestamp_ - time_us_) / 1000000.0;
+  time_us_ = enabled[0].timestamp_;
+
+  Prediction(delta_t);
+  UpdateStacked(enabled);
+}
+
 void UKF::Prediction(double delta_t) {
   /**
    * TODO: Complete this function! Estimate the object's location. 
    * Modify the state vector, x_. Predict sigma points, the state, 
    * and the state covariance matrix.
    */
-   // Define spreading parameter
-  lambda_ = 3 - n_x_;
-  
-  //create sigma point matrix
-  MatrixXd Xsig_ = MatrixXd(n_x_, 2 * n_x_ + 1);
-  
-  //calculate square root of P
-  MatrixXd A_ = P_.llt().matrixL();
-  
-  //calculate sigma points, set sigma points as columns of matrix Xsig_
-  Xsig_.col(0) = x_;
-  for(int i = 0; i < n_x_; i++) {
-    Xsig_.col(i+1) = x_ + std::sqrt(lambda_+n_x_)*A_.col(i);
-    Xsig_.col(i+1+n_x_) = x_ - std::sqrt(lambda_+n_x_)*A_.col(i);
-  }
-  
   // Define spreading parameter for augmentation
   lambda_ = 3 - n_aug_;
   
   //create augmented mean vector
   VectorXd x_aug_ = VectorXd(7);
   
-  //create augmented state covariance
-  MatrixXd P_aug_ = MatrixXd(7, 7);
-  
   //create sigma point matrix
   MatrixXd Xsig_aug_ = MatrixXd(n_aug_, 2 * n_aug_ + 1);
   
@@ -179,16 +345,31 @@ void UKF::Prediction(double delta_t) {
   x_aug_(5) = 0;
   x_aug_(6) = 0;
   
-  //create augmented covariance matrix
-  MatrixXd Q = MatrixXd(2,2);
-  Q << std_a_*std_a_, 0,
-        0, std_yawdd_*std_yawdd_;
-  P_aug_.fill(0.0);
-  P_aug_.topLeftCorner(5, 5) = P_;
-  P_aug_.bottomRightCorner(2, 2) = Q;
-  
   //create square root matrix
-  MatrixXd A_aug = P_aug_.llt().matrixL();
+  MatrixXd A_aug;
+  if (use_sqrt_) {
+    // P_sqrt_ is factored from P_ on the first square-root step, and again
+    // whenever P_ was set by anything but the square-root steps
+    if (!P_sqrt_valid_) {
+      P_sqrt_ = P_.llt().matrixL();
+      P_sqrt_valid_ = true;
+    }
+
+    // the factor of the augmented covariance is block diagonal, no factorization needed
+    A_aug = MatrixXd::Zero(n_aug_, n_aug_);
+    A_aug.topLeftCorner(5, 5) = P_sqrt_;
+    A_aug(5, 5) = std_a_;
+    A_aug(6, 6) = std_yawdd_;
+  } else {
+    //create augmented state covariance
+    MatrixXd P_aug_ = MatrixXd::Zero(7, 7);
+    MatrixXd Q = MatrixXd(2,2);
+    Q << std_a_*std_a_, 0,
+          0, std_yawdd_*std_yawdd_;
+    P_aug_.topLeftCorner(5, 5) = P_;
+    P_aug_.bottomRightCorner(2, 2) = Q;
+    A_aug = P_aug_.llt().matrixL();
+  }
   
   //create augmented sigma points
   Xsig_aug_.col(0) = x_aug_;
@@ -263,6 +444,30 @@ void UKF::Prediction(double delta_t) {
     //predict state mean
     x_pred += weights_(i) * Xsig_pred_.col(i);
   }
+
+  if (store_prediction_) {
+    // cross covariance of the state before and after the prediction
+    C_pred_ = MatrixXd::Zero(n_x_, n_x_);
+    for (int i = 0; i < 2 * n_aug_ + 1; i++) {
+      VectorXd prior_diff = Xsig_aug_.col(i).head(n_x_) - x_aug_.head(n_x_);
+      VectorXd pred_diff = Xsig_pred_.col(i) - x_pred;
+      NormalizeAngles(pred_diff, std::vector<int>(1, 3));
+      C_pred_ += weights_(i) * prior_diff * pred_diff.transpose();
+    }
+  }
+
+  if (use_sqrt_) {
+    // process noise is already in the augmented sigma points
+    x_ = x_pred;
+    if (!SqrtCovariance(Xsig_pred_, x_pred, weights_, MatrixXd(n_x_, 0), std::vector<int>(1, 3), P_sqrt_))
+      sqrt_failures_++;
+    P_ = P_sqrt_ * P_sqrt_.transpose();
+    if (store_prediction_) {
+      x_pred_ = x_;
+      P_pred_ = P_;
+    }
+    return;
+  }
   
   for (int i = 0; i < 2 * n_aug_ + 1; i++) {
     
@@ -280,98 +485,53 @@ void UKF::Prediction(double delta_t) {
   
   x_ = x_pred;
   P_ = P_pred;
+  P_sqrt_valid_ = false;
+  if (store_prediction_) {
+    x_pred_ = x_;
+    P_pred_ = P_;
+  }
 }
 
 void UKF::UpdateLidar(MeasurementPackage meas_package) {
   /**
-   * TODO: Complete this function! Use lidar data to update the belief 
-   * about the object's position. Modify the state vector, x_, and 
-   * covariance, P_.
-   * You can also calculate the lidar NIS, if desired.
+   * Lidar measures px and py directly, z = H x with a constant H, so the
+   * unscented transform of the sigma points gives exactly the linear Kalman
+   * update: z_pred = H x, S = H P H' + R and Tc = P H'. It is applied in
+   * closed form instead, with an LDLT solve in place of S.inverse().
    */
-   //set measurement dimension, lidar can measure px and py
-  int n_z = 2;
-  
-  //create matrix for sigma points in measurement space
-  MatrixXd Zsig = MatrixXd(n_z, 2 * n_aug_ + 1);
-  
-  //mean predicted measurement
-  VectorXd z_pred = VectorXd(n_z);
-  
+  //set measurement dimension, lidar can measure px and py
+  const int n_z = 2;
+
+  //H selects px and py, so P H' is the first two columns of P
+  MatrixXd PHt = P_.leftCols(n_z);
+
   //measurement covariance matrix S
-  MatrixXd S = MatrixXd(n_z,n_z);
-  
-  Zsig.fill(0.0);
-  z_pred.fill(0.0);
-  S.fill(0.0);
-  
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) {
-    //transform sigma points into measurement space
-    VectorXd state_vec = Xsig_pred_.col(i);
-    double px = state_vec(0);
-    double py = state_vec(1);
-    
-    Zsig.col(i) << px,
-                   py;
-    
-    //calculate mean predicted measurement
-    z_pred += weights_(i) * Zsig.col(i);
-  }
-  
-  //calculate measurement covariance matrix S
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) {
-    VectorXd z_diff = Zsig.col(i) - z_pred;
-    S += weights_(i) * z_diff * z_diff.transpose();
-  }
-  
-  // Add R to S
-  MatrixXd R = MatrixXd(2,2);
+  Eigen::Matrix2d R;
   R << std_laspx_*std_laspx_, 0,
        0, std_laspy_*std_laspy_;
-  S += R;
-  
-  //create vector for incoming radar measurement
-  VectorXd z = VectorXd(n_z);
-  
-  double meas_px = meas_package.raw_measurements_(0);
-  double meas_py = meas_package.raw_measurements_(1);
-  
-  z << meas_px,
-       meas_py;
-  
-  //create matrix for cross correlation Tc
-  MatrixXd Tc = MatrixXd(n_x_, n_z);
-  Tc.fill(0.0);
-  
-  //calculate cross correlation matrix
-  for (int i = 0; i < 2 * n_aug_ + 1; i++) {
-    VectorXd x_diff = Xsig_pred_.col(i) - x_;
-    
-    //normalize angles
-    while (x_diff(3) > M_PI) 
-      x_diff(3) -= 2. * M_PI;
-    while (x_diff(3) < -M_PI) 
-      x_diff(3) += 2. * M_PI;
-    
-    
-    VectorXd z_diff = Zsig.col(i) - z_pred;
+  Eigen::Matrix2d S = P_.topLeftCorner(n_z, n_z) + R;
 
-    Tc += weights_(i) * x_diff * z_diff.transpose();
-
-  }
-  
   // residual
-  VectorXd z_diff = z - z_pred;
-  
+  Eigen::Vector2d z_diff = meas_package.raw_measurements_.head(n_z) - x_.head(n_z);
+
+  //calculate Kalman gain K = P H' S^-1
+  Eigen::LDLT<Eigen::Matrix2d> ldlt(S);
+  MatrixXd K = ldlt.solve(PHt.transpose()).transpose();
+
   //calculate NIS
-  NIS_laser_ = z_diff.transpose() * S.inverse() * z_diff;
-  
-  //calculate Kalman gain K;
-  MatrixXd K = Tc * S.inverse();
-  
-  //update state mean and covariance matrix
+  NIS_laser_ = z_diff.dot(ldlt.solve(z_diff));
+
+  //update state mean and covariance matrix, K S K' = K H P
   x_ += K*z_diff;
-  P_ -= K*S*K.transpose();
+  if (use_sqrt_) {
+    Eigen::Matrix2d S_sqrt = S.llt().matrixL();
+    if (!CholeskyDowndate(P_sqrt_, P_, K * S_sqrt))
+      sqrt_failures_++;
+    P_ = P_sqrt_ * P_sqrt_.transpose();
+  } else {
+    P_ -= K*PHt.transpose();
+    P_sqrt_valid_ = false;
+  }
 }
 
 void UKF::UpdateRadar(MeasurementPackage meas_package) {
@@ -421,6 +581,27 @@ void UKF::UpdateRadar(MeasurementPackage meas_package) {
     z_pred += weights_(i) * Zsig.col(i);
   }
   
+  //R is diagonal, its factor holds the standard deviations
+  Eigen::Vector3d noise_std(std_radr_, std_radphi_, std_radrd_);
+  MatrixXd R = noise_std.array().square().matrix().asDiagonal();
+  
+  //create example vector for incoming radar measurement
+  VectorXd z = VectorXd(n_z);
+  
+  double meas_rho = meas_package.raw_measurements_(0);
+  double meas_phi = meas_package.raw_measurements_(1);
+  double meas_rhod = meas_package.raw_measurements_(2);
+  
+  z << meas_rho,
+       meas_phi,
+       meas_rhod;
+  
+  // the square-root update factors S itself
+  if (use_sqrt_) {
+    NIS_radar_ = UpdateSqrt(Zsig, z_pred, z, noise_std.asDiagonal(), std::vector<int>(1, 1));
+    return;
+  }
+
   //calculate measurement covariance matrix S
   for (int i = 0; i < 2 * n_aug_ + 1; i++) {
     VectorXd z_diff = Zsig.col(i) - z_pred;
@@ -433,23 +614,8 @@ void UKF::UpdateRadar(MeasurementPackage meas_package) {
   }
   
   // Add R to S
-  MatrixXd R = MatrixXd(3,3);
-  R << std_radr_*std_radr_, 0, 0,
-       0, std_radphi_*std_radphi_, 0,
-       0, 0, std_radrd_*std_radrd_;
   S += R;
-  
-  //create example vector for incoming radar measurement
-  VectorXd z = VectorXd(n_z);
-  
-  double meas_rho = meas_package.raw_measurements_(0);
-  double meas_phi = meas_package.raw_measurements_(1);
-  double meas_rhod = meas_package.raw_measurements_(2);
-  
-  z << meas_rho,
-       meas_phi,
-       meas_rhod;
-  
+
   //create matrix for cross correlation Tc
   MatrixXd Tc = MatrixXd(n_x_, n_z);
   Tc.fill(0.0);
@@ -493,4 +659,185 @@ void UKF::UpdateRadar(MeasurementPackage meas_package) {
   //update state mean and covariance matrix
   x_ += K*z_diff;
   P_ -= K*S*K.transpose();
+  P_sqrt_valid_ = false;
+}
+
+double UKF::UpdateSqrt(const MatrixXd& Zsig, const VectorXd& z_pred, const VectorXd& z,
+                       const MatrixXd& R_sqrt, const std::vector<int>& angle_indices, MatrixXd* S_out) {
+  int n_z = z.size();
+
+  //factor of the measurement covariance matrix S
+  MatrixXd S_sqrt;
+  if (!SqrtCovariance(Zsig, z_pred, weights_, R_sqrt, angle_indices, S_sqrt))
+    sqrt_failures_++;
+
+  //calculate cross correlation matrix
+  MatrixXd Tc = MatrixXd::Zero(n_x_, n_z);
+  for (int i = 0; i < 2 * n_aug_ + 1; i++) {
+    VectorXd x_diff = Xsig_pred_.col(i) - x_;
+    while (x_diff(3) > M_PI)
+      x_diff(3) -= 2. * M_PI;
+    while (x_diff(3) < -M_PI)
+      x_diff(3) += 2. * M_PI;
+
+    VectorXd z_diff = Zsig.col(i) - z_pred;
+    NormalizeAngles(z_diff, angle_indices);
+
+    Tc += weights_(i) * x_diff * z_diff.transpose();
+  }
+
+  // residual
+  VectorXd z_diff = z - z_pred;
+  NormalizeAngles(z_diff, angle_indices);
+
+  //Kalman gain K = Tc S^-1 from two triangular solves
+  MatrixXd K = S_sqrt.transpose().triangularView<Eigen::Upper>()
+                 .solve(S_sqrt.triangularView<Eigen::Lower>().solve(Tc.transpose())).transpose();
+  x_ += K*z_diff;
+
+  //P - K S K' = P - U U' with U = K S_sqrt
+  if (!CholeskyDowndate(P_sqrt_, P_, K * S_sqrt))
+    sqrt_failures_++;
+  P_ = P_sqrt_ * P_sqrt_.transpose();
+
+  if (S_out)
+    *S_out = S_sqrt * S_sqrt.transpose();
+
+  //NIS = z_diff' S^-1 z_diff
+  return S_sqrt.triangularView<Eigen::Lower>().solve(z_diff).squaredNorm();
+}
+
+void UKF::UpdateStacked(const std::vector<MeasurementPackage>& meas_packages) {
+  //stacked measurement dimension, where each package starts and the angle components
+  int n_z = 0;
+  std::vector<int> offsets;
+  std::vector<int> angle_indices;
+  for (const MeasurementPackage& meas_package : meas_packages) {
+    offsets.push_back(n_z);
+    if (meas_package.sensor_type_ == MeasurementPackage::RADAR) {
+      angle_indices.push_back(n_z + 1);
+      n_z += 3;
+    } else {
+      n_z += 2;
+    }
+  }
+
+  //sigma points in measurement space, measurement and the standard
+  //deviations on the diagonal of the factor of the block diagonal R
+  MatrixXd Zsig = MatrixXd(n_z, 2 * n_aug_ + 1);
+  VectorXd z = VectorXd(n_z);
+  VectorXd noise_std = VectorXd(n_z);
+  for (unsigned int k = 0; k < meas_packages.size(); k++) {
+    int o = offsets[k];
+    if (meas_packages[k].sensor_type_ == MeasurementPackage::RADAR) {
+      for (int i = 0; i < 2 * n_aug_ + 1; i++) {
+        double px = Xsig_pred_(0, i);
+        double py = Xsig_pred_(1, i);
+        double v = Xsig_pred_(2, i);
+        double yaw = Xsig_pred_(3, i);
+        double rho = sqrt(px*px+py*py);
+        Zsig(o, i) = rho;
+        Zsig(o + 1, i) = atan2(py,px);
+        Zsig(o + 2, i) = (px*cos(yaw)*v+py*sin(yaw)*v) / rho;
+      }
+      noise_std.segment(o, 3) << std_radr_, std_radphi_, std_radrd_;
+      z.segment(o, 3) = meas_packages[k].raw_measurements_.head(3);
+    } else {
+      Zsig.block(o, 0, 2, 2 * n_aug_ + 1) = Xsig_pred_.topRows(2);
+      noise_std.segment(o, 2) << std_laspx_, std_laspy_;
+      z.segment(o, 2) = meas_packages[k].raw_measurements_.head(2);
+    }
+  }
+
+  //mean predicted measurement
+  VectorXd z_pred = Zsig * weights_;
+
+  MatrixXd S;
+  if (use_sqrt_) {
+    UpdateSqrt(Zsig, z_pred, z, noise_std.asDiagonal(), angle_indices, &S);
+  } else {
+    /**
+     * A lidar row measures px or py, so its sigma point deviations are a row
+     * of the state deviations. Its column of Tc is a column of P_ and its row
+     * of S is that row of Tc, as in UpdateLidar. Only the radar columns of Tc
+     * and the radar blocks of S are summed over the sigma points.
+     */
+    std::vector<int> state_rows(n_z, -1);
+    std::vector<int> radar_index(n_z, -1);
+    std::vector<int> radar_angles;
+    int n_r = 0;
+    for (unsigned int k = 0; k < meas_packages.size(); k++) {
+      int o = offsets[k];
+      if (meas_packages[k].sensor_type_ == MeasurementPackage::RADAR) {
+        radar_angles.push_back(n_r + 1);
+        for (int j = 0; j < 3; j++)
+          radar_index[o + j] = n_r++;
+      } else {
+        state_rows[o] = 0;
+        state_rows[o + 1] = 1;
+      }
+    }
+
+    //radar blocks of S and radar columns of Tc, from the deviations of all
+    //sigma points at once
+    MatrixXd S_radar = MatrixXd(n_r, n_r);
+    MatrixXd Tc_radar = MatrixXd(n_x_, n_r);
+    if (n_r > 0) {
+      MatrixXd Z_diff = MatrixXd(n_r, 2 * n_aug_ + 1);
+      for (int j = 0; j < n_z; j++) {
+        if (radar_index[j] >= 0)
+          Z_diff.row(radar_index[j]) = Zsig.row(j).array() - z_pred(j);
+      }
+      NormalizeAngleRows(Z_diff, radar_angles);
+      MatrixXd X_diff = Xsig_pred_.colwise() - x_;
+      NormalizeAngleRows(X_diff, std::vector<int>(1, 3));
+
+      MatrixXd Z_weighted = Z_diff * weights_.asDiagonal();
+      S_radar = Z_weighted * Z_diff.transpose();
+      Tc_radar = X_diff * Z_weighted.transpose();
+    }
+
+    //cross correlation Tc and measurement covariance matrix S
+    MatrixXd Tc = MatrixXd(n_x_, n_z);
+    for (int j = 0; j < n_z; j++)
+      Tc.col(j) = state_rows[j] >= 0 ? P_.col(state_rows[j]) : Tc_radar.col(radar_index[j]);
+    S = noise_std.array().square().matrix().asDiagonal();
+    for (int a = 0; a < n_z; a++) {
+      for (int b = 0; b < n_z; b++) {
+        if (state_rows[a] >= 0)
+          S(a, b) += Tc(state_rows[a], b);
+        else if (state_rows[b] >= 0)
+          S(a, b) += Tc(state_rows[b], a);
+        else
+          S(a, b) += S_radar(radar_index[a], radar_index[b]);
+      }
+    }
+
+    // residual
+    VectorXd z_diff = z - z_pred;
+    NormalizeAngles(z_diff, angle_indices);
+
+    //calculate Kalman gain K = Tc S^-1
+    MatrixXd K = S.ldlt().solve(Tc.transpose()).transpose();
+
+    //update state mean and covariance matrix, K S K' = K Tc'
+    x_ += K*z_diff;
+    P_ -= K*Tc.transpose();
+    P_sqrt_valid_ = false;
+  }
+
+  //NIS of each sensor from its own block of S, the same value a separate update would give
+  for (unsigned int k = 0; k < meas_packages.size(); k++) {
+    int o = offsets[k];
+    bool radar = meas_packages[k].sensor_type_ == MeasurementPackage::RADAR;
+    int size = radar ? 3 : 2;
+    VectorXd z_diff = z.segment(o, size) - z_pred.segment(o, size);
+    if (radar)
+      NormalizeAngles(z_diff, std::vector<int>(1, 1));
+    double NIS = z_diff.dot(S.block(o, o, size, size).ldlt().solve(z_diff));
+    if (radar)
+      NIS_radar_ = NIS;
+    else
+      NIS_laser_ = NIS;
+  }
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef UKF_H
 #define UKF_H
 
+#include <vector>
 #include "Eigen/Dense"
 #include "measurement_package.h"
 
@@ -22,6 +23,28 @@ class UKF {
    */
   void ProcessMeasurement(MeasurementPackage meas_package);
 
+  /**
+   * ProcessMeasurements for measurements taken at the same time, e.g. lidar
+   * and radar of one frame. Predicts once and runs a single stacked update
+   * with a block diagonal R. Packages with different timestamps are
+   * processed one after another instead. Packages of a disabled sensor
+   * are dropped before stacking.
+   * @param meas_packages The latest measurements, in arrival order
+   */
+  void ProcessMeasurements(const std::vector<MeasurementPackage>& meas_packages);
+
+  /**
+   * @return Whether use_laser_ or use_radar_ allows updating with the package
+   */
+  bool SensorEnabled(const MeasurementPackage& meas_package) const;
+
+  /**
+   * Sets the state covariance matrix. Use it instead of assigning P_ so the
+   * square-root mode factors the new P_ on the next Prediction
+   * @param P The new state covariance matrix
+   */
+  void SetCovariance(const Eigen::MatrixXd& P);
+
   /**
    * Prediction Predicts sigma points, the state, and the state covariance
    * matrix
@@ -30,7 +53,8 @@ class UKF {
   void Prediction(double delta_t);
 
   /**
-   * Updates the state and the state covariance matrix using a laser measurement
+   * Updates the state and the state covariance matrix using a laser measurement,
+   * the lidar model is linear so this is a plain Kalman update
    * @param meas_package The measurement at k+1
    */
   void UpdateLidar(MeasurementPackage meas_package);
@@ -41,6 +65,29 @@ class UKF {
    */
   void UpdateRadar(MeasurementPackage meas_package);
 
+  /**
+   * Updates the state and the state covariance matrix with several
+   * measurements at once, stacked into one measurement vector. Lidar blocks
+   * are closed form as in UpdateLidar, only radar uses the sigma points
+   * @param meas_packages The measurements at k+1
+   */
+  void UpdateStacked(const std::vector<MeasurementPackage>& meas_packages);
+
+  /**
+   * Square-root measurement update, used by UpdateRadar and UpdateStacked when
+   * use_sqrt_ is set
+   * @param Zsig Predicted sigma points in measurement space
+   * @param z_pred Predicted measurement mean
+   * @param z The measurement at k+1
+   * @param R_sqrt Lower Cholesky factor of the measurement noise covariance
+   * @param angle_indices Measurement components holding an angle
+   * @param S_out If not null, receives the measurement covariance matrix S
+   * @return The NIS of the measurement
+   */
+  double UpdateSqrt(const Eigen::MatrixXd& Zsig, const Eigen::VectorXd& z_pred, const Eigen::VectorXd& z,
+                    const Eigen::MatrixXd& R_sqrt, const std::vector<int>& angle_indices,
+                    Eigen::MatrixXd* S_out = nullptr);
+
 
   // initially set to false, set to true in first call of ProcessMeasurement
   bool is_initialized_;
@@ -57,9 +104,36 @@ class UKF {
   // state covariance matrix
   Eigen::MatrixXd P_;
 
+  // if this is true, the lower Cholesky factor of P_ is propagated directly
+  // and P_ is only recomputed from it for readers
+  bool use_sqrt_;
+
+  // lower Cholesky factor of P_, kept in square-root mode
+  Eigen::MatrixXd P_sqrt_;
+
+  // false when P_ was set by anything but a square-root step, e.g. on the
+  // first one, Prediction factors P_ again then
+  bool P_sqrt_valid_;
+
+  // number of square-root steps whose downdate failed and kept the larger
+  // covariance instead
+  int sqrt_failures_;
+
   // predicted sigma points matrix
   Eigen::MatrixXd Xsig_pred_;
 
+  // if this is true, every Prediction stores x_pred_, P_pred_ and C_pred_
+  bool store_prediction_;
+
+  // predicted state mean and covariance of the last Prediction, before any
+  // update
+  Eigen::VectorXd x_pred_;
+  Eigen::MatrixXd P_pred_;
+
+  // cross covariance of the state before the last Prediction and the
+  // predicted state, what an RTS smoother needs for its gain
+  Eigen::MatrixXd C_pred_;
+
   // time when the state is true, in us
   long long time_us_;
 
@@ -0,0 +1,651 @@
+// Timings of the UKF variants and the parts around them, one bench function
+// per feature, listed in main. Where two implementations must agree the
+// difference is checked too, and the run exits with 1 if any check failed.
+// Usage: ukf_bench [steps] [tracks] [threads] [bench]
+
+// makes Eigen assert on any heap allocation while it is disallowed below
+#define EIGEN_RUNTIME_NO_MALLOC
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ukf.h"
+#include "ukf_fixed.h"
+#include "ukf_bank.h"
+#include "measurement_queue.h"
+#include "rollout.h"
+#include "imm.h"
+#include "association.h"
+#include "checkpoint.h"
+#include "scenario.h"
+#include "sensors/rng.h"
+
+// CTRV car on a slow turn, lidar and radar alternating at 30 Hz each, or
+// both every 1/60 s with the same timestamp when fused is set
+std::vector<MeasurementPackage> makeMeasurements(int steps, double offset = 0, bool fused = false) {
+  std::vector<MeasurementPackage> measurements;
+  measurements.reserve(fused ? 2 * steps : steps);
+  double x = 10 + offset, y = -2 - offset, v = 8, yaw = 0.1, yawd = 0.2;
+  long long time_us = 0;
+  for (int i = 0; i < steps; i++) {
+    double dt = 1.0 / 60;
+    x += v * cos(yaw) * dt;
+    y += v * sin(yaw) * dt;
+    yaw += yawd * dt;
+    yawd = 0.2 * sin(i * 0.005 + offset);
+    time_us += 1000000 / 60;
+
+    // small deterministic jitter in place of sensor noise
+    double jitter = 0.05 * sin(i * 1.7);
+    MeasurementPackage meas;
+    meas.timestamp_ = time_us;
+    if (fused || i % 2 == 0) {
+      meas.sensor_type_ = MeasurementPackage::LASER;
+      meas.raw_measurements_ = Eigen::VectorXd(2);
+      meas.raw_measurements_ << x + jitter, y - jitter;
+      measurements.push_back(meas);
+    }
+    if (fused || i % 2 == 1) {
+      double rho = sqrt(x*x + y*y);
+      meas.sensor_type_ = MeasurementPackage::RADAR;
+      meas.raw_measurements_ = Eigen::VectorXd(3);
+      meas.raw_measurements_ << rho + jitter, atan2(y, x), (x*cos(yaw)*v + y*sin(yaw)*v) / rho + jitter;
+      measurements.push_back(meas);
+    }
+  }
+  return measurements;
+}
+
+// Stop and go with lane changes like car3 in Highway, repeated every 10 s,
+// lidar and radar alternating at 30 Hz each with noise at the sensor model
+// standard deviations. truth gets [px py vx vy] at every measurement.
+std::vector<MeasurementPackage> makeManeuver(int steps, std::vector<Eigen::Vector4d>& truth, uint64_t seed = 1) {
+  std::vector<MeasurementPackage> measurements;
+  measurements.reserve(steps);
+  truth.clear();
+  truth.reserve(steps);
+  double x = 10, y = -2, v = 10, yaw = 0;
+  long long time_us = 0;
+  for (int i = 0; i < steps; i++) {
+    double dt = 1.0 / 60;
+    double phase = fmod(i * dt, 10.0);
+    double a = 0, yawd = 0;
+    if (phase >= 2 && phase < 3)
+      yawd = 0.4;
+    else if (phase >= 3 && phase < 4)
+      yawd = -0.4;
+    else if (phase >= 4 && phase < 6)
+      a = -4;
+    else if (phase >= 6 && phase < 8)
+      a = 4;
+    else if (phase >= 8)
+      yawd = 0.2;
+    x += v * cos(yaw) * dt;
+    y += v * sin(yaw) * dt;
+    v = std::max(0.0, v + a * dt);
+    yaw += yawd * dt;
+    time_us += 1000000 / 60;
+    truth.push_back(Eigen::Vector4d(x, y, v * cos(yaw), v * sin(yaw)));
+
+    MeasurementPackage meas;
+    meas.timestamp_ = time_us;
+    if (i % 2 == 0) {
+      meas.sensor_type_ = MeasurementPackage::LASER;
+      meas.raw_measurements_ = Eigen::VectorXd(2);
+      meas.raw_measurements_ << x + 0.15 * normalNoise(seed, i, 0), y + 0.15 * normalNoise(seed, i, 1);
+    } else {
+      double rho = sqrt(x*x + y*y);
+      meas.sensor_type_ = MeasurementPackage::RADAR;
+      meas.raw_measurements_ = Eigen::VectorXd(3);
+      meas.raw_measurements_ << rho + 0.3 * normalNoise(seed, i, 2), atan2(y, x) + 0.03 * normalNoise(seed, i, 3),
+          (x*cos(yaw)*v + y*sin(yaw)*v) / rho + 0.3 * normalNoise(seed, i, 4);
+    }
+    measurements.push_back(meas);
+  }
+  return measurements;
+}
+
+// squared error of the [px py vx vy] estimate of a CTRV state
+template <typename StateVector>
+Eigen::Vector4d squaredError(const StateVector& x, const Eigen::Vector4d& truth) {
+  Eigen::Vector4d estimate(x(0), x(1), x(2) * cos(x(3)), x(2) * sin(x(3)));
+  return (estimate - truth).cwiseAbs2();
+}
+// sizes shared by every benchmark, from the command line
+struct BenchConfig {
+  int steps;
+  int tracks;
+  int threads;
+};
+
+// checks that failed, main exits with 1 if there are any
+static int failedChecks = 0;
+
+// counts a failed check, e.g. two implementations that should agree but don't
+void check(bool ok, const std::string& what) {
+  if (!ok) {
+    std::cout << "CHECK FAILED: " << what << std::endl;
+    failedChecks++;
+  }
+}
+
+void checkBelow(double value, double limit, const std::string& what) {
+  std::ostringstream message;
+  message << what << " is " << value << ", limit " << limit;
+  check(value <= limit, message.str());
+}
+
+// wall time of one call of body in ns
+template <typename Func>
+double elapsedNs(Func body) {
+  auto startTime = std::chrono::steady_clock::now();
+  body();
+  auto endTime = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(endTime - startTime).count();
+}
+
+// every track gets a measurement each frame, as in stepHighway
+std::vector<std::vector<MeasurementPackage> > makeTracks(const BenchConfig& config, int frames) {
+  std::vector<std::vector<MeasurementPackage> > tracks;
+  for (int track = 0; track < config.tracks; track++)
+    tracks.push_back(makeMeasurements(frames, 0.1 * track));
+  return tracks;
+}
+
+int trackFrames(const BenchConfig& config) {
+  return std::max(1, std::min(config.steps, 1000));
+}
+
+// UKF in its dense and square-root modes against the allocation free FixedUKF
+void benchSingleFilter(const BenchConfig& config) {
+  std::vector<MeasurementPackage> measurements = makeMeasurements(config.steps);
+
+  UKF ukf;
+  double dynamicNs = elapsedNs([&] {
+    for (const MeasurementPackage& meas : measurements)
+      ukf.ProcessMeasurement(meas);
+  }) / config.steps;
+
+  UKF sqrtUkf;
+  sqrtUkf.use_sqrt_ = true;
+  double sqrtNs = elapsedNs([&] {
+    for (const MeasurementPackage& meas : measurements)
+      sqrtUkf.ProcessMeasurement(meas);
+  }) / config.steps;
+
+  CTRVFixedUKF fixed;
+  Eigen::internal::set_is_malloc_allowed(false);
+  double fixedNs = elapsedNs([&] {
+    for (const MeasurementPackage& meas : measurements)
+      fixed.ProcessMeasurement(meas);
+  }) / config.steps;
+  Eigen::internal::set_is_malloc_allowed(true);
+
+  double sqrtStateDifference = (ukf.x_ - sqrtUkf.x_).cwiseAbs().maxCoeff();
+  double sqrtCovarianceDifference = (ukf.P_ - sqrtUkf.P_).cwiseAbs().maxCoeff();
+  double fixedStateDifference = (ukf.x_ - fixed.x_).cwiseAbs().maxCoeff();
+  std::cout << "UKF took " << dynamicNs << " ns per step" << std::endl;
+  std::cout << "UKF square-root mode took " << sqrtNs << " ns per step, max state difference "
+            << sqrtStateDifference << ", max covariance difference " << sqrtCovarianceDifference << ", "
+            << sqrtUkf.sqrt_failures_ << " failed downdates" << std::endl;
+  std::cout << "FixedUKF took " << fixedNs << " ns per step (" << dynamicNs / fixedNs << "x), max state difference "
+            << fixedStateDifference << std::endl;
+  checkBelow(sqrtStateDifference, 1e-9, "square-root UKF state difference");
+  checkBelow(sqrtCovarianceDifference, 1e-9, "square-root UKF covariance difference");
+  checkBelow(fixedStateDifference, 1e-9, "FixedUKF state difference");
+
+  // both initialize from the first measurement the same way whichever sensor it comes from
+  UKF radarFirstUkf;
+  CTRVFixedUKF radarFirstFixed;
+  for (size_t i = 1; i < measurements.size() && i <= 1000; i++) {
+    radarFirstUkf.ProcessMeasurement(measurements[i]);
+    radarFirstFixed.ProcessMeasurement(measurements[i]);
+  }
+  checkBelow((radarFirstUkf.x_ - radarFirstFixed.x_).cwiseAbs().maxCoeff(), 1e-9,
+             "FixedUKF state difference on a radar first stream");
+}
+
+// lidar and radar of the same frame, one after another and stacked
+void benchStacked(const BenchConfig& config) {
+  int frames = std::max(1, config.steps / 2);
+  std::vector<MeasurementPackage> measurements = makeMeasurements(frames, 0, true);
+
+  UKF sequentialUkf;
+  double sequentialNs = elapsedNs([&] {
+    for (const MeasurementPackage& meas : measurements)
+      sequentialUkf.ProcessMeasurement(meas);
+  }) / frames;
+
+  UKF stackedUkf;
+  std::vector<MeasurementPackage> frame(2);
+  double stackedNs = elapsedNs([&] {
+    for (int i = 0; i < frames; i++) {
+      frame[0] = measurements[2 * i];
+      frame[1] = measurements[2 * i + 1];
+      stackedUkf.ProcessMeasurements(frame);
+    }
+  }) / frames;
+
+  // not the same filter, the sequential radar update linearizes around the
+  // lidar corrected state, so only close agreement is expected
+  double difference = (sequentialUkf.x_ - stackedUkf.x_).cwiseAbs().maxCoeff();
+  std::cout << "lidar+radar frame, sequential updates took " << sequentialNs << " ns, stacked update took "
+            << stackedNs << " ns (" << sequentialNs / stackedNs << "x), max state difference " << difference << std::endl;
+  checkBelow(difference, 1e-2, "stacked against sequential state difference");
+}
+
+// accuracy on a maneuvering car, CTRV alone against the CV/CTRV/CTRA IMM.
+// The IMM has to win at every checked run length and noise seed, not only
+// on average over one long run
+void benchImm(const BenchConfig& config) {
+  std::vector<Eigen::Vector4d> truth;
+  std::vector<MeasurementPackage> maneuver = makeManeuver(config.steps, truth);
+
+  UKF ukf;
+  double dynamicNs = elapsedNs([&] {
+    for (const MeasurementPackage& meas : maneuver)
+      ukf.ProcessMeasurement(meas);
+  }) / config.steps;
+
+  CTRVFixedUKF ctrv;
+  Eigen::Vector4d ctrvError = Eigen::Vector4d::Zero();
+  for (int i = 0; i < config.steps; i++) {
+    ctrv.ProcessMeasurement(maneuver[i]);
+    ctrvError += squaredError(ctrv.x_, truth[i]);
+  }
+
+  IMMTracker imm;
+  Eigen::Vector4d immError = Eigen::Vector4d::Zero();
+  Eigen::Vector3d modeSum = Eigen::Vector3d::Zero();
+  double immNs = elapsedNs([&] {
+    for (int i = 0; i < config.steps; i++) {
+      imm.ProcessMeasurement(maneuver[i]);
+      immError += squaredError(imm.x_, truth[i]);
+      modeSum += imm.mode_probability_;
+    }
+  }) / config.steps;
+
+  Eigen::Vector4d ctrvRmse = (ctrvError / config.steps).cwiseSqrt();
+  Eigen::Vector4d immRmse = (immError / config.steps).cwiseSqrt();
+  std::cout << "IMMTracker took " << immNs << " ns per step (" << immNs / dynamicNs << "x UKF), maneuver RMSE X Y Vx Vy: CTRV "
+            << ctrvRmse.transpose() << ", IMM " << immRmse.transpose()
+            << ", mean mode probability CV CTRV CTRA " << (modeSum / config.steps).transpose() << std::endl;
+
+  // RMSE over the first n steps for each checked n, from one run per seed
+  std::vector<int> lengths = {600, 1000, 2000, 3000};
+  if (config.steps > lengths.back())
+    lengths.push_back(config.steps);
+  const int seeds = 4;
+  double worstRatio = 0;
+  int worstLength = 0, worstSeed = 0;
+  for (int seed = 1; seed <= seeds; seed++) {
+    maneuver = makeManeuver(lengths.back(), truth, seed);
+    CTRVFixedUKF seedCtrv;
+    IMMTracker seedImm;
+    ctrvError.setZero();
+    immError.setZero();
+    size_t next = 0;
+    for (int i = 0; i < lengths.back(); i++) {
+      seedCtrv.ProcessMeasurement(maneuver[i]);
+      ctrvError += squaredError(seedCtrv.x_, truth[i]);
+      seedImm.ProcessMeasurement(maneuver[i]);
+      immError += squaredError(seedImm.x_, truth[i]);
+      if (i + 1 == lengths[next]) {
+        double ratio = (immError.array() / ctrvError.array()).sqrt().maxCoeff();
+        if (ratio > worstRatio) {
+          worstRatio = ratio;
+          worstLength = lengths[next];
+          worstSeed = seed;
+        }
+        next++;
+      }
+    }
+  }
+  std::cout << "IMM against CTRV over the first";
+  for (int length : lengths)
+    std::cout << " " << length;
+  std::cout << " steps of " << seeds << " seeds: worst RMSE ratio " << worstRatio << " (" << worstLength
+            << " steps, seed " << worstSeed << ")" << std::endl;
+  checkBelow(worstRatio, 1, "IMM RMSE over CTRV alone on the maneuver");
+}
+
+// track updates per second of a bank with num_threads threads, bank_states
+// gets the state of every track
+double runBank(const std::vector<std::vector<MeasurementPackage> >& tracks, int& num_threads,
+               std::vector<UKFBank::StateVector, Eigen::aligned_allocator<UKFBank::StateVector> >& bank_states) {
+  UKFBank bank(num_threads);
+  num_threads = bank.NumThreads();
+  bank.Reserve(tracks.size());
+  for (size_t track = 0; track < tracks.size(); track++)
+    bank.AddTrack();
+
+  size_t updates = 0;
+  double ns = elapsedNs([&] {
+    for (size_t frame = 0; frame < tracks[0].size(); frame++) {
+      for (size_t track = 0; track < tracks.size(); track++)
+        bank.AddMeasurement(track, tracks[track][frame]);
+      updates += bank.ProcessPending();
+    }
+  });
+  bank_states.resize(tracks.size());
+  for (size_t track = 0; track < tracks.size(); track++)
+    bank_states[track] = bank.State(track);
+  return updates / (ns * 1e-9);
+}
+
+// many tracks, one FixedUKF each against UKFBank, about 1.15x at -O2 and
+// 1.4x at -O3 on one core, the per lane trig calls stay scalar
+void benchBank(const BenchConfig& config) {
+  int frames = trackFrames(config);
+  std::vector<std::vector<MeasurementPackage> > tracks = makeTracks(config, frames);
+
+  std::vector<CTRVFixedUKF, Eigen::aligned_allocator<CTRVFixedUKF> > filters(config.tracks);
+  double sequentialNs = elapsedNs([&] {
+    for (int frame = 0; frame < frames; frame++) {
+      for (int track = 0; track < config.tracks; track++)
+        filters[track].ProcessMeasurement(tracks[track][frame]);
+    }
+  });
+  double sequentialRate = config.tracks * (double)frames / (sequentialNs * 1e-9);
+  std::cout << config.tracks << " tracks, one FixedUKF each: " << sequentialRate << " track updates/s" << std::endl;
+
+  std::vector<UKFBank::StateVector, Eigen::aligned_allocator<UKFBank::StateVector> > bankStates;
+  for (int pass = 0; pass < 2; pass++) {
+    int threads = pass == 0 ? 1 : config.threads;
+    double rate = runBank(tracks, threads, bankStates);
+    double difference = 0;
+    for (int track = 0; track < config.tracks; track++)
+      difference = std::max(difference, (bankStates[track] - filters[track].x_).cwiseAbs().maxCoeff());
+    std::cout << "UKFBank " << threads << " threads: " << rate << " track updates/s (" << rate / sequentialRate
+              << "x), max state difference " << difference << std::endl;
+    checkBelow(difference, 1e-9, "UKFBank state difference with " + std::to_string(threads) + " threads");
+  }
+}
+
+// 2 s predicted paths for every track, repeated UKF::Prediction on a copy
+// of each filter as ukfResults used to do, against one CTRVRollout call
+void benchRollout(const BenchConfig& config) {
+  int frames = trackFrames(config);
+  std::vector<std::vector<MeasurementPackage> > tracks = makeTracks(config, frames);
+  std::vector<CTRVFixedUKF, Eigen::aligned_allocator<CTRVFixedUKF> > filters(config.tracks);
+  for (int track = 0; track < config.tracks; track++) {
+    for (int frame = 0; frame < frames; frame++)
+      filters[track].ProcessMeasurement(tracks[track][frame]);
+  }
+
+  const int horizonSteps = 20;
+  const double horizonDt = 0.1;
+  std::vector<double> trackStates((size_t)config.tracks * CTRVRollout::kStateSize);
+  std::vector<double> trackCovariances((size_t)config.tracks * CTRVRollout::kCovarianceSize);
+  for (int track = 0; track < config.tracks; track++) {
+    std::copy(filters[track].x_.data(), filters[track].x_.data() + CTRVRollout::kStateSize,
+              &trackStates[track * CTRVRollout::kStateSize]);
+    std::copy(filters[track].P_.data(), filters[track].P_.data() + CTRVRollout::kCovarianceSize,
+              &trackCovariances[track * CTRVRollout::kCovarianceSize]);
+  }
+
+  UKF trackUkf;
+  Eigen::Vector2d lastPrediction = Eigen::Vector2d::Zero();
+  double predictionUs = 1e-3 * elapsedNs([&] {
+    for (int track = 0; track < config.tracks; track++) {
+      UKF copy = trackUkf;
+      copy.x_ = filters[track].x_;
+      copy.SetCovariance(filters[track].P_);
+      for (int step = 0; step < horizonSteps; step++)
+        copy.Prediction(horizonDt);
+      lastPrediction = copy.x_.head(2);
+    }
+  });
+
+  CTRVRollout rollout;
+  double meanUs = 1e-3 * elapsedNs([&] {
+    rollout.Run(trackStates.data(), nullptr, config.tracks, horizonDt, horizonSteps);
+  });
+  double covarianceUs = 1e-3 * elapsedNs([&] {
+    rollout.Run(trackStates.data(), trackCovariances.data(), config.tracks, horizonDt, horizonSteps);
+  });
+  // the closed form mean differs from the sigma point mean, it is shown but not checked
+  Eigen::Vector2d lastRollout(rollout.Px(config.tracks - 1, horizonSteps - 1), rollout.Py(config.tracks - 1, horizonSteps - 1));
+  std::cout << config.tracks << " tracks x " << horizonSteps << " steps rollout: UKF::Prediction took " << predictionUs
+            << " us, CTRVRollout mean " << meanUs << " us (" << predictionUs / meanUs << "x), with covariance "
+            << covarianceUs << " us, last track end point difference " << (lastPrediction - lastRollout).norm()
+            << " m" << std::endl;
+}
+
+// lidar and radar driver threads feeding one filter, each kept within two
+// frames of the other like real sensors running off the same clock
+void benchFrontEnd(const BenchConfig& config) {
+  int queued = std::min(config.steps, 20000);
+  std::vector<MeasurementPackage> measurements = makeMeasurements(queued);
+  UKF referenceUkf;
+  for (int i = 0; i < queued; i++)
+    referenceUkf.ProcessMeasurement(measurements[i]);
+
+  UKF queuedUkf;
+  MeasurementFrontEnd frontEnd(queuedUkf, 50000, 256);
+  std::atomic<int> progress[2];
+  progress[0] = 0;
+  progress[1] = 0;
+  size_t maxDepth = 0;
+  auto producer = [&](int sensor) {
+    for (int i = sensor; i < queued; i += 2) {
+      while (i > progress[1 - sensor].load() + 4 && progress[1 - sensor].load() < queued - 1)
+        std::this_thread::yield();
+      while (!frontEnd.Push(measurements[i]))
+        std::this_thread::yield();
+      progress[sensor] = i;
+    }
+    progress[sensor] = queued;
+  };
+  double ns = elapsedNs([&] {
+    frontEnd.Start();
+    std::thread lidarThread(producer, 0);
+    std::thread radarThread(producer, 1);
+    while (progress[0].load() < queued || progress[1].load() < queued) {
+      maxDepth = std::max(maxDepth, frontEnd.QueueDepth());
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    lidarThread.join();
+    radarThread.join();
+    frontEnd.Stop();
+  });
+  MeasurementFrontEnd::Counters counters = frontEnd.GetCounters();
+  double difference = (queuedUkf.x_ - referenceUkf.x_).cwiseAbs().maxCoeff();
+  std::cout << "MeasurementFrontEnd: " << counters.applied / (ns * 1e-9)
+            << " measurements/s, pushed " << counters.pushed << ", full " << counters.dropped_full << ", reordered "
+            << counters.reordered << ", late " << counters.late << ", max depth " << maxDepth
+            << ", max state difference " << difference << std::endl;
+  check(counters.applied == (uint64_t)queued, "MeasurementFrontEnd applied " + std::to_string(counters.applied) +
+        " of " + std::to_string(queued) + " measurements");
+  // every measurement applied in timestamp order gives the reference filter exactly
+  check(counters.applied != (uint64_t)queued || difference == 0,
+        "MeasurementFrontEnd state differs from the reference by " + std::to_string(difference));
+}
+
+// unlabeled detections of config.tracks cars on 3.5 m lanes, shuffled every frame
+void benchAssociation(const BenchConfig& config) {
+  int lanes = std::max(1, (int)std::sqrt((double)config.tracks));
+  TrafficScenario traffic;
+  for (int car = 0; car < config.tracks; car++)
+    traffic.AddCar("car" + std::to_string(car), 5 + 12.0 * (car / lanes), 3.5 * (car % lanes - lanes / 2), 10 + car % lanes, 0);
+  MultiTargetTracker tracker;
+  std::vector<MeasurementPackage> detections;
+  std::vector<std::pair<double, int> > order(config.tracks);
+  const int frames = 300;
+  double associationNs = 0;
+  for (int frame = 1; frame <= frames; frame++) {
+    long long time_us = frame * 1000000LL / 30;
+    traffic.Step(1.0 / 30, time_us);
+    for (int car = 0; car < config.tracks; car++)
+      order[car] = std::make_pair(normalNoise(2, frame, car), car);
+    std::sort(order.begin(), order.end());
+    detections.clear();
+    for (int k = 0; k < config.tracks; k++) {
+      int car = order[k].second;
+      double x = traffic.Px(car), y = traffic.Py(car), v = traffic.Velocity(car);
+      MeasurementPackage meas;
+      meas.timestamp_ = time_us;
+      meas.sensor_type_ = MeasurementPackage::LASER;
+      meas.raw_measurements_ = Eigen::VectorXd(2);
+      meas.raw_measurements_ << x + 0.15 * normalNoise(3, frame, 2 * k), y + 0.15 * normalNoise(3, frame, 2 * k + 1);
+      detections.push_back(meas);
+      double rho = sqrt(x*x + y*y);
+      meas.sensor_type_ = MeasurementPackage::RADAR;
+      meas.raw_measurements_ = Eigen::VectorXd(3);
+      meas.raw_measurements_ << rho + 0.3 * normalNoise(4, frame, 3 * k), atan2(y, x) + 0.03 * normalNoise(4, frame, 3 * k + 1),
+          x * v / rho + 0.3 * normalNoise(4, frame, 3 * k + 2);
+      detections.push_back(meas);
+    }
+    associationNs += elapsedNs([&] { tracker.ProcessDetections(detections); });
+  }
+
+  int found = 0, confirmed = 0;
+  for (size_t track = 0; track < tracker.Tracks().size(); track++)
+    confirmed += tracker.Tracks()[track].confirmed;
+  double squaredError = 0;
+  for (int car = 0; car < config.tracks; car++) {
+    int track = tracker.Nearest(traffic.Px(car), traffic.Py(car), 1.0);
+    if (track < 0)
+      continue;
+    found++;
+    squaredError += (tracker.Tracks()[track].filter.x_.head<2>() - Eigen::Vector2d(traffic.Px(car), traffic.Py(car))).squaredNorm();
+  }
+  std::cout << "MultiTargetTracker: " << config.tracks << " cars, " << 1e-6 * associationNs / frames
+            << " ms per frame of " << 2 * config.tracks << " detections, " << confirmed << " confirmed tracks, "
+            << found << " cars tracked within 1 m, position RMSE " << std::sqrt(squaredError / std::max(found, 1))
+            << std::endl;
+  check(found == config.tracks, "MultiTargetTracker tracks " + std::to_string(found) + " of " +
+        std::to_string(config.tracks) + " cars within 1 m");
+}
+
+// motion alone, 16 times as many cars as tracks each with a few actuations
+void benchScenario(const BenchConfig& config) {
+  int lanes = std::max(1, (int)std::sqrt((double)config.tracks));
+  TrafficScenario crowd;
+  for (int car = 0; car < 16 * config.tracks; car++) {
+    crowd.AddCar("car" + std::to_string(car), 8.0 * (car / lanes), 3.5 * (car % lanes), 5 + car % 7, 0);
+    for (int k = 1; k <= 3; k++)
+      crowd.AddActuation(car, k * 1000000LL + car % 1000 * 1000, normalNoise(5, car, k), 0.1 * normalNoise(6, car, k));
+  }
+  const int frames = 300;
+  double ns = elapsedNs([&] {
+    for (int frame = 1; frame <= frames; frame++)
+      crowd.Step(1.0 / 30, frame * 1000000LL / 30);
+  });
+  std::cout << "TrafficScenario: " << crowd.Size() << " cars, " << ns / frames / crowd.Size() << " ns per car step" << std::endl;
+}
+
+// UKFs checkpointed every 10 frames, then resuming at the middle of the run
+// from the checkpoint file against replaying from the start
+void benchCheckpoints(const BenchConfig& config) {
+  int frames = trackFrames(config);
+  std::vector<std::vector<MeasurementPackage> > tracks = makeTracks(config, frames);
+  const char* checkpointPath = "ukf_bench_checkpoints.bin";
+  std::vector<UKF> checkpointUkfs(config.tracks);
+  std::vector<const UKF*> checkpointTracks;
+  for (int track = 0; track < config.tracks; track++)
+    checkpointTracks.push_back(&checkpointUkfs[track]);
+  CheckpointWriter writer;
+  writer.Open(checkpointPath);
+  double runMs = 1e-6 * elapsedNs([&] {
+    for (int frame = 0; frame < frames; frame++) {
+      for (int track = 0; track < config.tracks; track++)
+        checkpointUkfs[track].ProcessMeasurement(tracks[track][frame]);
+      if (frame % 10 == 9)
+        writer.Write(tracks[0][frame].timestamp_, checkpointTracks);
+    }
+  });
+  writer.Close();
+
+  int resumeFrame = frames / 2;
+  std::vector<UKF> replayed(config.tracks);
+  double replayMs = 1e-6 * elapsedNs([&] {
+    for (int frame = 0; frame <= resumeFrame; frame++) {
+      for (int track = 0; track < config.tracks; track++)
+        replayed[track].ProcessMeasurement(tracks[track][frame]);
+    }
+  });
+
+  std::vector<UKF> restored(config.tracks);
+  std::vector<UKF*> restoredTracks;
+  for (int track = 0; track < config.tracks; track++)
+    restoredTracks.push_back(&restored[track]);
+  CheckpointReader reader;
+  bool restoredOk = false;
+  double restoreUs = 1e-3 * elapsedNs([&] {
+    reader.Open(checkpointPath);
+    int checkpoint = reader.Find(tracks[0][resumeFrame].timestamp_);
+    restoredOk = checkpoint >= 0 && reader.Restore(checkpoint, restoredTracks);
+  });
+  // the checkpoint may be a few frames before resumeFrame, catch up to it
+  int caughtUp = 0;
+  for (int frame = 0; restoredOk && frame <= resumeFrame; frame++) {
+    for (int track = 0; track < config.tracks; track++) {
+      if (tracks[track][frame].timestamp_ > restored[track].time_us_) {
+        restored[track].ProcessMeasurement(tracks[track][frame]);
+        caughtUp++;
+      }
+    }
+  }
+  double difference = 0;
+  for (int track = 0; track < config.tracks; track++)
+    difference = std::max(difference, (restored[track].x_ - replayed[track].x_).cwiseAbs().maxCoeff());
+  std::cout << "checkpoints: " << reader.Size() << " of " << config.tracks << " tracks written during a " << runMs
+            << " ms run, resuming at frame " << resumeFrame << " by replay took " << replayMs << " ms, open and restore "
+            << restoreUs << " us (" << restoredOk << ") plus " << caughtUp << " catch up steps, max state difference "
+            << difference << std::endl;
+  reader.Close();
+  std::remove(checkpointPath);
+  check(restoredOk, "no checkpoint restored");
+  check(difference == 0, "resumed state differs from the replayed one by " + std::to_string(difference));
+}
+
+int main(int argc, char** argv) {
+  BenchConfig config;
+  config.steps = argc > 1 ? atoi(argv[1]) : 200000;
+  config.tracks = argc > 2 ? atoi(argv[2]) : 256;
+  config.threads = argc > 3 ? atoi(argv[3]) : 0;
+  std::string only = argc > 4 ? argv[4] : "";
+  if (config.steps <= 0 || config.tracks <= 0) {
+    std::cerr << "Usage: ukf_bench [steps] [tracks] [threads] [bench]" << std::endl;
+    return 2;
+  }
+
+  struct Bench {
+    const char* name;
+    void (*run)(const BenchConfig&);
+  };
+  const Bench benches[] = {
+    {"filter", benchSingleFilter},
+    {"stacked", benchStacked},
+    {"imm", benchImm},
+    {"bank", benchBank},
+    {"rollout", benchRollout},
+    {"frontend", benchFrontEnd},
+    {"association", benchAssociation},
+    {"scenario", benchScenario},
+    {"checkpoints", benchCheckpoints},
+  };
+  bool ran = false;
+  for (const Bench& bench : benches) {
+    if (only.empty() || only == bench.name) {
+      bench.run(config);
+      ran = true;
+    }
+  }
+  if (!ran) {
+    std::cerr << "unknown bench " << only << std::endl;
+    return 2;
+  }
+  if (failedChecks > 0) {
+    std::cout << failedChecks << " checks failed" << std::endl;
+    return 1;
+  }
+  return 0;
+}
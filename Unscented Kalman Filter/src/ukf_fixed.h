@@ -0,0 +1,433 @@
+#ifndef UKF_FIXED_H
+#define UKF_FIXED_H
+
+#include <cmath>
+#include <type_traits>
+#include "Eigen/Dense"
+#include "measurement_package.h"
+
+/**
+ * Wraps an angle into [-pi, pi]
+ */
+inline double NormalizeAngle(double angle) {
+  while (angle > M_PI)
+    angle -= 2. * M_PI;
+  while (angle < -M_PI)
+    angle += 2. * M_PI;
+  return angle;
+}
+
+/**
+ * CTRV process model on the state [px py v yaw yawd], augmented with the
+ * longitudinal and yaw acceleration noise.
+ */
+struct CTRVModel {
+  enum { kStateSize = 5, kNoiseSize = 2, kAngleIndex = 3 };
+
+  CTRVModel() : std_a_(2.0), std_yawdd_(1.0) {}
+
+  // Process noise standard deviation longitudinal acceleration in m/s^2
+  double std_a_;
+
+  // Process noise standard deviation yaw acceleration in rad/s^2
+  double std_yawdd_;
+
+  Eigen::Matrix<double, kNoiseSize, kNoiseSize> NoiseCovariance() const {
+    Eigen::Matrix<double, kNoiseSize, kNoiseSize> Q;
+    Q << std_a_*std_a_, 0,
+         0, std_yawdd_*std_yawdd_;
+    return Q;
+  }
+
+  /**
+   * Propagates one augmented sigma point by delta_t
+   */
+  template <typename AugVector, typename StateVector>
+  static void Predict(const AugVector& x_aug, double delta_t, StateVector& x_pred) {
+    double px = x_aug(0);
+    double py = x_aug(1);
+    double v = x_aug(2);
+    double yaw = x_aug(3);
+    double yawd = x_aug(4);
+    double nu_a = x_aug(5);
+    double nu_yawdd = x_aug(6);
+
+    // same yaw rate threshold as UKF::Prediction
+    if (yawd > .001) {
+      px += (v/yawd)*(sin(yaw+yawd*delta_t) - sin(yaw));
+      py += (v/yawd)*(-cos(yaw+yawd*delta_t) + cos(yaw));
+    } else {
+      px += v*cos(yaw)*delta_t;
+      py += v*sin(yaw)*delta_t;
+    }
+
+    x_pred(0) = px + .5*delta_t*delta_t*cos(yaw)*nu_a;
+    x_pred(1) = py + .5*delta_t*delta_t*sin(yaw)*nu_a;
+    x_pred(2) = v + delta_t*nu_a;
+    x_pred(3) = yaw + yawd*delta_t + .5*delta_t*delta_t*nu_yawdd;
+    x_pred(4) = yawd + delta_t*nu_yawdd;
+  }
+};
+
+/**
+ * Lidar measures [px py]. The model is linear, z = H x, so FixedUKF applies
+ * the closed form Kalman update instead of the unscented transform.
+ */
+struct LidarModel {
+  enum { kSize = 2, kAngleIndex = -1, kLinear = 1 };
+
+  LidarModel() : std_laspx_(0.15), std_laspy_(0.15) {}
+
+  // Laser measurement noise standard deviation position1 in m
+  double std_laspx_;
+
+  // Laser measurement noise standard deviation position2 in m
+  double std_laspy_;
+
+  Eigen::Matrix<double, kSize, kSize> NoiseCovariance() const {
+    Eigen::Matrix<double, kSize, kSize> R;
+    R << std_laspx_*std_laspx_, 0,
+         0, std_laspy_*std_laspy_;
+    return R;
+  }
+
+  template <typename StateVector, typename MeasVector>
+  static void Measure(const StateVector& x, MeasVector& z) {
+    z(0) = x(0);
+    z(1) = x(1);
+  }
+
+  /**
+   * H of z = H x for a state of size NX
+   */
+  template <int NX>
+  static Eigen::Matrix<double, kSize, NX> MeasurementMatrix() {
+    Eigen::Matrix<double, kSize, NX> H = Eigen::Matrix<double, kSize, NX>::Zero();
+    H(0, 0) = 1;
+    H(1, 1) = 1;
+    return H;
+  }
+};
+
+/**
+ * Radar measures [rho phi rho_dot]
+ */
+struct RadarModel {
+  enum { kSize = 3, kAngleIndex = 1, kLinear = 0 };
+
+  RadarModel() : std_radr_(0.3), std_radphi_(0.03), std_radrd_(0.3) {}
+
+  // Radar measurement noise standard deviation radius in m
+  double std_radr_;
+
+  // Radar measurement noise standard deviation angle in rad
+  double std_radphi_;
+
+  // Radar measurement noise standard deviation radius change in m/s
+  double std_radrd_;
+
+  Eigen::Matrix<double, kSize, kSize> NoiseCovariance() const {
+    Eigen::Matrix<double, kSize, kSize> R;
+    R << std_radr_*std_radr_, 0, 0,
+         0, std_radphi_*std_radphi_, 0,
+         0, 0, std_radrd_*std_radrd_;
+    return R;
+  }
+
+  template <typename StateVector, typename MeasVector>
+  static void Measure(const StateVector& x, MeasVector& z) {
+    double px = x(0);
+    double py = x(1);
+    double v = x(2);
+    double yaw = x(3);
+
+    z(0) = sqrt(px*px + py*py);
+    z(1) = atan2(py, px);
+    z(2) = (px*cos(yaw)*v + py*sin(yaw)*v) / z(0);
+  }
+};
+
+/**
+ * Unscented Kalman filter with compile time state and augmented state sizes.
+ * Every matrix is a fixed size Eigen type, so Prediction and Update never
+ * touch the heap. The process model and the measurement models are template
+ * parameters, the defaults use the same equations and noise values as UKF.
+ */
+template <int NX, int NAUG, typename ProcessModel = CTRVModel>
+class FixedUKF {
+ public:
+  enum { kSigmaPoints = 2 * NAUG + 1 };
+
+  typedef Eigen::Matrix<double, NX, 1> StateVector;
+  typedef Eigen::Matrix<double, NX, NX> StateMatrix;
+  typedef Eigen::Matrix<double, NAUG, 1> AugVector;
+  typedef Eigen::Matrix<double, NAUG, NAUG> AugMatrix;
+  typedef Eigen::Matrix<double, NX, kSigmaPoints> SigmaMatrix;
+  typedef Eigen::Matrix<double, kSigmaPoints, 1> WeightVector;
+
+  FixedUKF()
+      : is_initialized_(false), use_laser_(true), use_radar_(true),
+        time_us_(0), NIS_laser_(0), NIS_radar_(0) {
+    static_assert(NX == ProcessModel::kStateSize, "state size does not match the process model");
+    static_assert(NAUG == NX + ProcessModel::kNoiseSize, "augmented size does not match the process noise");
+
+    x_.setZero();
+    P_.setIdentity();
+    Xsig_pred_.setZero();
+
+    // same spreading parameter and weights as UKF
+    lambda_ = 3 - NAUG;
+    weights_.fill(.5 / (lambda_ + NAUG));
+    weights_(0) = lambda_ / (lambda_ + NAUG);
+  }
+
+  /**
+   * ProcessMeasurement
+   * @param meas_package The latest measurement data of either radar or laser
+   */
+  void ProcessMeasurement(const MeasurementPackage& meas_package) {
+    ProcessMeasurement(meas_package.sensor_type_, meas_package.timestamp_, meas_package.raw_measurements_.data());
+  }
+
+  /**
+   * ProcessMeasurement without the MeasurementPackage vector
+   * @param sensor_type LASER or RADAR
+   * @param timestamp Measurement time in us
+   * @param z LidarModel::kSize or RadarModel::kSize values
+   */
+  void ProcessMeasurement(MeasurementPackage::SensorType sensor_type, long long timestamp, const double* z) {
+    if (!is_initialized_) {
+      x_.setZero();
+      P_.setIdentity();
+      if (sensor_type == MeasurementPackage::RADAR) {
+        x_(0) = z[0] * cos(z[1]);
+        x_(1) = z[0] * sin(z[1]);
+        x_(2) = z[2];
+        x_(3) = z[1];
+        P_(0, 0) = P_(1, 1) = radar_.std_radr_*radar_.std_radr_;
+        P_(2, 2) = radar_.std_radrd_*radar_.std_radrd_;
+      } else {
+        x_(0) = z[0];
+        x_(1) = z[1];
+        P_(0, 0) = lidar_.std_laspx_*lidar_.std_laspx_;
+        P_(1, 1) = lidar_.std_laspy_*lidar_.std_laspy_;
+      }
+      is_initialized_ = true;
+      time_us_ = timestamp;
+      return;
+    }
+
+    double delta_t = (timestamp - time_us_) / 1000000.0;
+    time_us_ = timestamp;
+    Prediction(delta_t);
+
+    if (sensor_type == MeasurementPackage::RADAR) {
+      if (use_radar_)
+        NIS_radar_ = Update(radar_, Eigen::Matrix<double, RadarModel::kSize, 1>(z[0], z[1], z[2]));
+    } else if (use_laser_) {
+      NIS_laser_ = Update(lidar_, Eigen::Matrix<double, LidarModel::kSize, 1>(z[0], z[1]));
+    }
+  }
+
+  /**
+   * Prediction Predicts sigma points, the state, and the state covariance
+   * matrix
+   * @param delta_t Time between k and k+1 in s
+   */
+  void Prediction(double delta_t) {
+    AugVector x_aug = AugVector::Zero();
+    x_aug.template head<NX>() = x_;
+
+    AugMatrix P_aug = AugMatrix::Zero();
+    P_aug.template topLeftCorner<NX, NX>() = P_;
+    P_aug.template bottomRightCorner<NAUG - NX, NAUG - NX>() = process_.NoiseCovariance();
+
+    AugMatrix A_aug = P_aug.llt().matrixL();
+    double spread = std::sqrt(lambda_ + NAUG);
+
+    AugVector sigma;
+    StateVector predicted;
+    ProcessModel::Predict(x_aug, delta_t, predicted);
+    Xsig_pred_.col(0) = predicted;
+    for (int i = 0; i < NAUG; ++i) {
+      sigma = x_aug + spread * A_aug.col(i);
+      ProcessModel::Predict(sigma, delta_t, predicted);
+      Xsig_pred_.col(i + 1) = predicted;
+
+      sigma = x_aug - spread * A_aug.col(i);
+      ProcessModel::Predict(sigma, delta_t, predicted);
+      Xsig_pred_.col(i + 1 + NAUG) = predicted;
+    }
+
+    x_ = Xsig_pred_ * weights_;
+
+    P_.setZero();
+    StateVector x_diff;
+    for (int i = 0; i < kSigmaPoints; ++i) {
+      x_diff = Xsig_pred_.col(i) - x_;
+      x_diff(ProcessModel::kAngleIndex) = NormalizeAngle(x_diff(ProcessModel::kAngleIndex));
+      P_.noalias() += weights_(i) * x_diff * x_diff.transpose();
+    }
+  }
+
+  /**
+   * Predicted measurement and innovation covariance from the sigma points of
+   * the latest Prediction, without updating, e.g. to gate detections
+   */
+  template <typename MeasModel>
+  void PredictMeasurement(const MeasModel& model, Eigen::Matrix<double, MeasModel::kSize, 1>& z_pred,
+                          Eigen::Matrix<double, MeasModel::kSize, MeasModel::kSize>& S) const {
+    enum { NZ = MeasModel::kSize };
+    Eigen::Matrix<double, NZ, kSigmaPoints> Zsig;
+    Eigen::Matrix<double, NZ, 1> z_sig;
+    for (int i = 0; i < kSigmaPoints; ++i) {
+      MeasModel::Measure(Xsig_pred_.col(i), z_sig);
+      Zsig.col(i) = z_sig;
+    }
+    z_pred = Zsig * weights_;
+
+    S = model.NoiseCovariance();
+    for (int i = 0; i < kSigmaPoints; ++i) {
+      z_sig = Zsig.col(i) - z_pred;
+      if (MeasModel::kAngleIndex >= 0)
+        z_sig(MeasModel::kAngleIndex) = NormalizeAngle(z_sig(MeasModel::kAngleIndex));
+      S.noalias() += weights_(i) * z_sig * z_sig.transpose();
+    }
+  }
+
+  /**
+   * Update with any measurement model, unscented for nonlinear models and
+   * the closed form Kalman update for models with kLinear set
+   * @param model The measurement model and its noise
+   * @param z The measurement at k+1
+   * @param S_out If given, receives the innovation covariance
+   * @return The NIS of the measurement
+   */
+  template <typename MeasModel>
+  double Update(const MeasModel& model, const Eigen::Matrix<double, MeasModel::kSize, 1>& z,
+                Eigen::Matrix<double, MeasModel::kSize, MeasModel::kSize>* S_out = nullptr) {
+    return Update(model, z, S_out, std::integral_constant<bool, MeasModel::kLinear != 0>());
+  }
+
+  /**
+   * Unscented update through the sigma points of the latest Prediction
+   */
+  template <typename MeasModel>
+  double Update(const MeasModel& model, const Eigen::Matrix<double, MeasModel::kSize, 1>& z,
+                Eigen::Matrix<double, MeasModel::kSize, MeasModel::kSize>* S_out, std::false_type) {
+    enum { NZ = MeasModel::kSize };
+    typedef Eigen::Matrix<double, NZ, 1> MeasVector;
+    typedef Eigen::Matrix<double, NZ, NZ> MeasMatrix;
+
+    // transform sigma points into measurement space
+    Eigen::Matrix<double, NZ, kSigmaPoints> Zsig;
+    MeasVector z_sig;
+    for (int i = 0; i < kSigmaPoints; ++i) {
+      MeasModel::Measure(Xsig_pred_.col(i), z_sig);
+      Zsig.col(i) = z_sig;
+    }
+    MeasVector z_pred = Zsig * weights_;
+
+    // innovation covariance S and cross correlation Tc
+    MeasMatrix S = model.NoiseCovariance();
+    Eigen::Matrix<double, NX, NZ> Tc = Eigen::Matrix<double, NX, NZ>::Zero();
+    MeasVector z_diff;
+    StateVector x_diff;
+    for (int i = 0; i < kSigmaPoints; ++i) {
+      z_diff = Zsig.col(i) - z_pred;
+      if (MeasModel::kAngleIndex >= 0)
+        z_diff(MeasModel::kAngleIndex) = NormalizeAngle(z_diff(MeasModel::kAngleIndex));
+      x_diff = Xsig_pred_.col(i) - x_;
+      x_diff(ProcessModel::kAngleIndex) = NormalizeAngle(x_diff(ProcessModel::kAngleIndex));
+
+      S.noalias() += weights_(i) * z_diff * z_diff.transpose();
+      Tc.noalias() += weights_(i) * x_diff * z_diff.transpose();
+    }
+
+    // residual
+    z_diff = z - z_pred;
+    if (MeasModel::kAngleIndex >= 0)
+      z_diff(MeasModel::kAngleIndex) = NormalizeAngle(z_diff(MeasModel::kAngleIndex));
+
+    MeasMatrix S_inv = S.inverse();
+    Eigen::Matrix<double, NX, NZ> K = Tc * S_inv;
+
+    x_.noalias() += K * z_diff;
+    P_.noalias() -= K * S * K.transpose();
+
+    if (S_out)
+      *S_out = S;
+    return z_diff.dot(S_inv * z_diff);
+  }
+
+  /**
+   * Kalman update for z = H x. After Prediction x_ and P_ are the weighted
+   * mean and covariance of the sigma points, so this gives the same result
+   * as the unscented transform without touching them.
+   */
+  template <typename MeasModel>
+  double Update(const MeasModel& model, const Eigen::Matrix<double, MeasModel::kSize, 1>& z,
+                Eigen::Matrix<double, MeasModel::kSize, MeasModel::kSize>* S_out, std::true_type) {
+    static_assert(MeasModel::kAngleIndex < 0, "a linear measurement model cannot measure an angle");
+    enum { NZ = MeasModel::kSize };
+    typedef Eigen::Matrix<double, NZ, NZ> MeasMatrix;
+
+    const Eigen::Matrix<double, NZ, NX> H = MeasModel::template MeasurementMatrix<NX>();
+    Eigen::Matrix<double, NX, NZ> PHt = P_ * H.transpose();
+    MeasMatrix S = H * PHt + model.NoiseCovariance();
+    Eigen::Matrix<double, NZ, 1> z_diff = z - H * x_;
+
+    // K = P H' S^-1, and K S K' = K H P
+    Eigen::LDLT<MeasMatrix> ldlt(S);
+    Eigen::Matrix<double, NX, NZ> K = ldlt.solve(PHt.transpose()).transpose();
+    x_.noalias() += K * z_diff;
+    P_.noalias() -= K * PHt.transpose();
+
+    if (S_out)
+      *S_out = S;
+    return z_diff.dot(ldlt.solve(z_diff));
+  }
+
+  // initially set to false, set to true in first call of ProcessMeasurement
+  bool is_initialized_;
+
+  // if this is false, laser measurements will be ignored (except for init)
+  bool use_laser_;
+
+  // if this is false, radar measurements will be ignored (except for init)
+  bool use_radar_;
+
+  // state vector and covariance
+  StateVector x_;
+  StateMatrix P_;
+
+  // predicted sigma points matrix
+  SigmaMatrix Xsig_pred_;
+
+  // Weights of sigma points
+  WeightVector weights_;
+
+  // Sigma point spreading parameter
+  double lambda_;
+
+  // time when the state is true, in us
+  long long time_us_;
+
+  // process model and its noise
+  ProcessModel process_;
+
+  // sensor models used by ProcessMeasurement
+  LidarModel lidar_;
+  RadarModel radar_;
+
+  // NIS of the latest laser and radar update
+  double NIS_laser_;
+  double NIS_radar_;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+};
+
+// drop-in fixed size equivalent of UKF
+typedef FixedUKF<5, 7, CTRVModel> CTRVFixedUKF;
+
+#endif  // UKF_FIXED_H
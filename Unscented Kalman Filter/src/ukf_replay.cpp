@@ -0,0 +1,172 @@
+// Records the Highway scenario to a measurement log, or replays a log
+// through one UKF per recorded track as fast as the filters run. A replay
+// fuses lidar and radar of one frame and scores against the logged ground
+// truth like stepHighway does, so it reproduces the recorded run's RMSE.
+// With a checkpoint file the replay resumes at a given time instead of
+// running from the start.
+// Usage: ukf_replay record <log> [checkpoints] [seed]
+//        ukf_replay <log> [repeats] [checkpoints start time in s]
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "highway.h"
+
+int record(const std::string& logPath, const char* checkpointPath, long long seed) {
+  pcl::visualization::PCLVisualizer::Ptr viewer;
+  Highway highway(viewer);
+  highway.tools.noiseSeed = seed;
+  MeasurementLogWriter log;
+  if (!log.Open(logPath)) {
+    std::cerr << "can not write " << logPath << std::endl;
+    return 1;
+  }
+  highway.tools.recorder = &log;
+  CheckpointWriter checkpoints;
+  if (checkpointPath) {
+    if (!checkpoints.Open(checkpointPath)) {
+      std::cerr << "can not write " << checkpointPath << std::endl;
+      return 1;
+    }
+    highway.checkpoints = &checkpoints;
+  }
+
+  // same timing as main.cpp
+  int frame_per_sec = 30;
+  int sec_interval = 10;
+  double egoVelocity = 25;
+  for (int frame_count = 0; frame_count < frame_per_sec * sec_interval; frame_count++) {
+    long long time_us = 1000000LL * frame_count / frame_per_sec;
+    highway.stepHighway(egoVelocity, time_us, frame_per_sec, viewer);
+  }
+
+  VectorXd rmse = highway.tools.rmse.rmse();
+  std::cout << "recorded " << log.Records() << " records, RMSE X Y Vx Vy: " << rmse.transpose() << std::endl;
+  return 0;
+}
+
+struct ReplayResult {
+  size_t updates;
+  double seconds;
+  RMSEAccumulator rmse;
+  NISAccumulator lidarNIS;
+  NISAccumulator radarNIS;
+
+  ReplayResult() : updates(0), seconds(0), rmse(4), lidarNIS(2), radarNIS(3) {}
+};
+
+// replays records [begin, log.Size()), ukfs hold the state at begin
+ReplayResult replay(const MeasurementLogReader& log, size_t begin, std::vector<UKF>& ukfs) {
+  ReplayResult result;
+  std::vector<MeasurementPackage> frame;
+  VectorXd estimate(4);
+  VectorXd truth(4);
+  auto startTime = std::chrono::steady_clock::now();
+  size_t i = begin;
+  while (i < log.Size()) {
+    const MeasurementRecord& record = log[i];
+    // without a track hint there is no filter to feed
+    if (record.track < 0) {
+      i++;
+      continue;
+    }
+    UKF& ukf = ukfs[record.track];
+    if (record.type == MeasurementRecord::kGroundTruth) {
+      double v = ukf.x_(2), yaw = ukf.x_(3);
+      estimate << ukf.x_(0), ukf.x_(1), cos(yaw) * v, sin(yaw) * v;
+      truth = Eigen::Map<const VectorXd>(record.values, 4);
+      result.rmse.add(estimate, truth);
+      // the first frame only initializes the filter
+      if (record.timestamp > 0) {
+        result.lidarNIS.add(ukf.NIS_laser_);
+        result.radarNIS.add(ukf.NIS_radar_);
+      }
+      i++;
+      continue;
+    }
+    // measurements of the same track and time were one fused frame when recorded
+    frame.clear();
+    for (; i < log.Size() && log[i].type != MeasurementRecord::kGroundTruth && log[i].track == record.track &&
+           log[i].timestamp == record.timestamp; i++) {
+      frame.push_back(MeasurementPackage());
+      log[i].ToPackage(&frame.back());
+    }
+    ukf.ProcessMeasurements(frame);
+    result.updates += frame.size();
+  }
+  auto endTime = std::chrono::steady_clock::now();
+  result.seconds = std::chrono::duration<double>(endTime - startTime).count();
+  return result;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "usage: ukf_replay record <log> [checkpoints] [seed]" << std::endl
+              << "       ukf_replay <log> [repeats] [checkpoints start time in s]" << std::endl;
+    return 1;
+  }
+  if (std::string(argv[1]) == "record") {
+    if (argc < 3) {
+      std::cerr << "usage: ukf_replay record <log> [checkpoints] [seed]" << std::endl;
+      return 1;
+    }
+    return record(argv[2], argc > 3 ? argv[3] : nullptr, argc > 4 ? atoll(argv[4]) : 0);
+  }
+
+  MeasurementLogReader log;
+  if (!log.Open(argv[1])) {
+    std::cerr << "can not read measurement log " << argv[1] << std::endl;
+    return 1;
+  }
+  int repeats = argc > 2 ? std::max(1, atoi(argv[2])) : 1;
+  int tracks = 0;
+  for (size_t i = 0; i < log.Size(); i++)
+    tracks = std::max(tracks, log[i].track + 1);
+
+  CheckpointReader checkpoints;
+  int checkpoint = -1;
+  if (argc > 3) {
+    if (!checkpoints.Open(argv[3])) {
+      std::cerr << "can not read checkpoints " << argv[3] << std::endl;
+      return 1;
+    }
+    long long start_us = argc > 4 ? (long long)(atof(argv[4]) * 1e6) : 0;
+    checkpoint = checkpoints.Find(start_us);
+    if (checkpoint >= 0 && checkpoints.Tracks(checkpoint) < tracks) {
+      std::cerr << "checkpoint holds " << checkpoints.Tracks(checkpoint) << " tracks, the log " << tracks << std::endl;
+      return 1;
+    }
+  }
+
+  ReplayResult best;
+  size_t begin = 0;
+  double restoreUs = 0;
+  for (int repeat = 0; repeat < repeats; repeat++) {
+    std::vector<UKF> ukfs(tracks);
+    if (checkpoint >= 0) {
+      auto startTime = std::chrono::steady_clock::now();
+      std::vector<UKF*> restored;
+      for (UKF& ukf : ukfs)
+        restored.push_back(&ukf);
+      checkpoints.Restore(checkpoint, restored);
+      begin = log.FindAfter(checkpoints.Timestamp(checkpoint));
+      auto endTime = std::chrono::steady_clock::now();
+      restoreUs = std::chrono::duration<double, std::micro>(endTime - startTime).count();
+    }
+    ReplayResult result = replay(log, begin, ukfs);
+    if (repeat == 0 || result.seconds < best.seconds)
+      best = result;
+  }
+
+  if (checkpoint >= 0)
+    std::cout << "resumed from the checkpoint at " << checkpoints.Timestamp(checkpoint) / 1e6 << " s in "
+              << restoreUs << " us, skipping " << begin << " of " << log.Size() << " records" << std::endl;
+  std::cout << "replayed " << best.updates << " measurements of " << tracks << " tracks in " << best.seconds * 1e3
+            << " ms, " << best.updates / best.seconds << " updates/s" << std::endl;
+  std::cout << "RMSE X Y Vx Vy: " << best.rmse.rmse().transpose() << std::endl;
+  std::cout << "NIS mean lidar " << best.lidarNIS.mean() << " radar " << best.radarNIS.mean() << ", above 95% bound "
+            << best.lidarNIS.percentAbove() << "% " << best.radarNIS.percentAbove() << "%" << std::endl;
+  return 0;
+}
@@ -0,0 +1,117 @@
+// Smooths the tracks of a measurement log written by ukf_replay record with
+// the unscented RTS smoother, in full batch and fixed-lag mode, and compares
+// both with the forward UKF against the logged ground truth. Every copy
+// filters all tracks of the log once more as separate tracks, to measure
+// throughput on more data than one recorded drive.
+// Usage: ukf_smooth <log> [lag] [copies] [threads]
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "accumulators.h"
+#include "measurement_log.h"
+#include "smoother.h"
+
+struct Truth {
+  int track;
+  int step;
+  Eigen::VectorXd values;
+};
+
+Eigen::VectorXd toEstimate(const URTSSmoother::StateVector& x) {
+  Eigen::VectorXd estimate(4);
+  estimate << x(0), x(1), cos(x(3)) * x(2), sin(x(3)) * x(2);
+  return estimate;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "usage: ukf_smooth <log> [lag] [copies] [threads]" << std::endl;
+    return 1;
+  }
+  MeasurementLogReader log;
+  if (!log.Open(argv[1])) {
+    std::cerr << "can not read measurement log " << argv[1] << std::endl;
+    return 1;
+  }
+  int lag = argc > 2 ? atoi(argv[2]) : 10;
+  int copies = argc > 3 ? std::max(1, atoi(argv[3])) : 1;
+  URTSSmoother smoother(argc > 4 ? atoi(argv[4]) : 0);
+
+  int logTracks = 0;
+  for (size_t i = 0; i < log.Size(); i++)
+    logTracks = std::max(logTracks, log[i].track + 1);
+  int tracks = logTracks * copies;
+  std::vector<UKF> ukfs(tracks);
+  for (int track = 0; track < tracks; track++) {
+    ukfs[track].store_prediction_ = true;
+    smoother.AddTrack();
+  }
+
+  // forward pass, lidar and radar of one frame fused as when recorded
+  std::vector<Truth> truths;
+  std::vector<MeasurementPackage> frame;
+  size_t updates = 0;
+  auto startTime = std::chrono::steady_clock::now();
+  for (int copy = 0; copy < copies; copy++) {
+    size_t i = 0;
+    while (i < log.Size()) {
+      const MeasurementRecord& record = log[i];
+      if (record.track < 0) {
+        i++;
+        continue;
+      }
+      int track = copy * logTracks + record.track;
+      if (record.type == MeasurementRecord::kGroundTruth) {
+        // only the first copy is scored, the others repeat it
+        if (copy == 0 && smoother.Steps(track) > 0) {
+          Truth truth = {track, smoother.Steps(track) - 1, Eigen::Map<const Eigen::VectorXd>(record.values, 4)};
+          truths.push_back(truth);
+        }
+        i++;
+        continue;
+      }
+      frame.clear();
+      for (; i < log.Size() && log[i].type != MeasurementRecord::kGroundTruth && log[i].track == record.track &&
+             log[i].timestamp == record.timestamp; i++) {
+        frame.push_back(MeasurementPackage());
+        log[i].ToPackage(&frame.back());
+      }
+      ukfs[track].ProcessMeasurements(frame);
+      smoother.Record(track, ukfs[track]);
+      updates++;
+    }
+  }
+  auto endTime = std::chrono::steady_clock::now();
+  double forwardSeconds = std::chrono::duration<double>(endTime - startTime).count();
+
+  RMSEAccumulator forward(4), full(4), lagged(4);
+  for (const Truth& truth : truths)
+    forward.add(toEstimate(smoother.FilteredState(truth.track, truth.step)), truth.values);
+
+  startTime = std::chrono::steady_clock::now();
+  smoother.Smooth();
+  endTime = std::chrono::steady_clock::now();
+  double fullSeconds = std::chrono::duration<double>(endTime - startTime).count();
+  for (const Truth& truth : truths)
+    full.add(toEstimate(smoother.SmoothedState(truth.track, truth.step)), truth.values);
+
+  startTime = std::chrono::steady_clock::now();
+  smoother.Smooth(lag);
+  endTime = std::chrono::steady_clock::now();
+  double lagSeconds = std::chrono::duration<double>(endTime - startTime).count();
+  for (const Truth& truth : truths)
+    lagged.add(toEstimate(smoother.SmoothedState(truth.track, truth.step)), truth.values);
+
+  std::cout << tracks << " tracks, " << updates << " steps, backward passes on " << smoother.NumThreads()
+            << " threads" << std::endl;
+  std::cout << "forward UKF: " << updates / forwardSeconds << " steps/s, RMSE X Y Vx Vy "
+            << forward.rmse().transpose() << std::endl;
+  std::cout << "full batch smoother: " << updates / fullSeconds << " steps/s, RMSE X Y Vx Vy "
+            << full.rmse().transpose() << std::endl;
+  std::cout << "fixed lag " << lag << " smoother: " << updates / lagSeconds << " steps/s, RMSE X Y Vx Vy "
+            << lagged.rmse().transpose() << std::endl;
+  return 0;
+}